@@ -3,30 +3,36 @@
   Written by: Gerbert Funes, Sara Ali
 
   Depends on
-  https://github.com/Goober56/ESP32Servo
   https://www.arduino.cc/reference/en/libraries/arduinoble/
   */
 
+// Uncomment, or build with -DARM_PROFILING, to compile in the profiling probes served on /metrics (see profiler.h)
+//#define ARM_PROFILING
+
 #include <SPI.h>
 #include <Wire.h>
 #include <esp_now.h>
-#include <ESP32Servo.h>
+#include "servoOutput.h"
 #include <ArduinoBLE.h>
 #include "armServer.h"
 #include "WebSerial.h"
-#include "processToeButtons.h"
+#include "flightRecorder.h"
+#include "compressedOta.h"
+#include "radioCoexistence.h"
+#include "profiler.h"
 #include "wristRotations.h"
+#include "processToeButtons.h"
+#include "powerManager.h"
 #include "Arduino.h"
 
 #define LED_BUILTIN 2
 
-/**
-* Reset Function to restart arm through serial
-*/
-void (*resetFunc)(void) = 0;
 float gyroState[3];  // x, y, z
 bool systemActive = false;
 
+unsigned long sleeveTickMS = 10;  // control tick period of the main loop, the BLE loop reads about this often
+unsigned long lastSleeveTickMS = 0;
+
 // Define the structure to store the received data
 struct payloadStruct {
   float footButton;
@@ -35,6 +41,8 @@ struct payloadStruct {
   float pitchValue;
   float footYaw;
   float yawValue;
+  uint8_t pressureMode;    // 1 when toePressure carries the toes and footButton is -1
+  uint8_t toePressure[2];  // big toe, small toes, 0 to 255
 } receivedData;
 
 // Define the UUID of the characteristic that carries the message
@@ -45,6 +53,8 @@ const char *messageCharacteristicUUID = "19b10001-e8f2-537e-4f6c-d104768a1214";
 typedef struct StructMessage {
   float footButton;
   float buttonValue;
+  uint8_t pressureMode;
+  uint8_t toePressure[2];
 } StructMessage;
 
 // Create a struct_message called buttonData
@@ -54,9 +64,18 @@ StructMessage buttonData;
    Ingest button from Foot Controller Sleeve
  */
 void OnDataRecv(const uint8_t *mac, const uint8_t *data, int len) {
-  memcpy(&buttonData, data, sizeof(buttonData));
+  unsigned long receivedUS = micros();
+  // Older sleeves send only the button fields
+  memset(&buttonData, 0, sizeof(buttonData));
+  memcpy(&buttonData, data, min(len, (int)sizeof(buttonData)));
   //Button Message
-  ButtonAssign(buttonData.footButton, buttonData.buttonValue);
+  if (buttonData.pressureMode) {
+    PressureAssign(buttonData.toePressure, SOURCE_FOOT_SLEEVE);
+  } else {
+    flightRecord(RECORD_TOE_EDGE, SOURCE_FOOT_SLEEVE, buttonData.footButton, buttonData.buttonValue);
+    ButtonAssign(buttonData.footButton, buttonData.buttonValue, false);
+  }
+  radioEspNowReceived(receivedUS);
 }
 
 void setup() {
@@ -65,6 +84,10 @@ void setup() {
 */
   Serial.begin(115200);
   Serial.println("Setup begun");
+  profileLoopTask = xTaskGetCurrentTaskHandle();
+
+  // Saves the previous recording if the arm was reset by a fault
+  flightRecorderBegin();
 
 /**
 * Setting up the server
@@ -103,6 +126,9 @@ void setup() {
 
   BLE.scan();
 
+  // Pin the shared channel and let control traffic win the radio, needs Wi-Fi and BLE to be running
+  radioCoexBegin();
+
 /**
 *Servos
 */
@@ -121,10 +147,24 @@ void setup() {
   // Bending Servos
   bendingServo.attach(bendingPin);
   bendingServo.write(bendingMotorPos);
+
+  // All joints are attached, start driving them together
+  servoOutputBegin();
+  powerBegin();
 }
 
 void loop() {
 
+  otaLoop();
+  radioCoexLoop();
+  powerLoop();
+
+  // Without the Foot Controller nothing else moves the hand, so the Foot Sleeve gets its control ticks here
+  if (millis() - lastSleeveTickMS >= sleeveTickMS) {
+    lastSleeveTickMS = millis();
+    controlTick();
+  }
+
   BLEDevice peripheral = BLE.available();
 
   if (peripheral) {
@@ -148,6 +188,7 @@ void explorePeripheral(BLEDevice peripheral) {
 
   if (peripheral.connect()) {
     Serial.println("Connected");
+    flightRecord(RECORD_LINK, SOURCE_FOOT_CONTROLLER, 1, 0);
   } else {
     Serial.println("Failed to connect!");
     return;
@@ -198,16 +239,26 @@ void exploreCharacteristic(BLECharacteristic characteristic) {
     Serial.println("ConnectedController: NoTapeController");
     delay(20);
     while (characteristic.canRead() & BLE.connected()) {
+      PROFILE_SCOPE("blePass");
+      profileLoopPass();
+      unsigned long readStartUS = micros();
       characteristic.read();
-      if (characteristic.valueLength() == sizeof(payloadStruct)) {
+      bleReadLatency.record(micros() - readStartUS);
+      // Older Foot Controllers send the payload without the pressure fields
+      int valueLength = characteristic.valueLength();
+      if (valueLength == sizeof(payloadStruct) || valueLength == offsetof(payloadStruct, pressureMode)) {
         const uint8_t *receivedDataBytes = characteristic.value();
-        memcpy(&receivedData, receivedDataBytes, sizeof(payloadStruct));
+        memset(&receivedData, 0, sizeof(payloadStruct));
+        memcpy(&receivedData, receivedDataBytes, valueLength);
         readBleMessages(receivedData);
-        processToeButtons();
+        controlTick();
         ElegantOTA.loop();
+        otaLoop();
+        radioCoexLoop();
       }
     }
     Serial.println("Cannot Read :(");
+    flightRecord(RECORD_LINK, SOURCE_FOOT_CONTROLLER, 0, 0);
     BLE.scan();
     loop();
   } else {
@@ -215,10 +266,33 @@ void exploreCharacteristic(BLECharacteristic characteristic) {
   }
 }
 
+/**
+  Act on the inputs from both foot units and commit the servos. The BLE loop runs it after every read, the main
+  loop every sleeveTickMS while the Foot Controller is not connected.
+ */
+void controlTick() {
+  radioControlTick();
+  powerLoop();
+  processToeButtons();
+  {
+    PROFILE_SCOPE("commitServoOutputs");
+    commitServoOutputs();
+  }
+  radioServoCommitted();
+  flightRecordServoOutputs();
+}
+
 /**
   In order to combine both the USB-C insole and the wireless insole into one system this function was created. Both the foot sleeve and insole send their button data to this function. This functions job is to get rid of conflicting data between both controllers. It will allow the arm to switch between the insole and the wireless foot sleeve without having to reflash the arm. 
  */
-void ButtonAssign(int toeButton, int toeButtonValue){
+void ButtonAssign(int toeButton, int toeButtonValue, bool fromPressure){
+  queueToeEdge(toeButton, toeButtonValue == 1);
+  if (toeButtonValue == 1) {
+    portENTER_CRITICAL(&toePressureLock);
+    toePressureMapper.press(toeButton, fromPressure);
+    portEXIT_CRITICAL(&toePressureLock);
+  }
+
   if (toeButton == 0){
     lastBigToeState = toeButtonValue;
     bigToeValue = toeButtonValue;
@@ -234,13 +308,47 @@ void ButtonAssign(int toeButton, int toeButtonValue){
   }
 }
 
+/**
+  Turn toe pressures into presses and releases for the mode and grip logic, the pressure itself sets the grip speed
+ */
+void PressureAssign(const uint8_t *toePressure, uint8_t source) {
+  for (int toe = 0; toe < 2; toe++) {
+    portENTER_CRITICAL(&toePressureLock);
+    bool changed = toePressure[toe] != toePressureMapper.getPressure(toe);
+    bool edge = toePressureMapper.sample(toe, toePressure[toe]);
+    bool down = toePressureMapper.isDown(toe);
+    portEXIT_CRITICAL(&toePressureLock);
+
+    if (changed) flightRecord(RECORD_TOE_PRESSURE, source, toe, toePressure[toe]);
+    if (!edge) continue;
+    flightRecord(RECORD_TOE_EDGE, SOURCE_ARM, toe, down);
+    ButtonAssign(toe, down, true);
+  }
+}
+
 /**
   Ingest button and axis messages from Foot Controller Unit
  */
 void readBleMessages(payloadStruct data) {
+  PROFILE_SCOPE("readBleMessages");
+
+  // The characteristic is read over and over, only record payloads that changed
+  static payloadStruct lastRecordedData;
+  if (memcmp(&data, &lastRecordedData, sizeof(payloadStruct)) != 0) {
+    if (!data.pressureMode) flightRecord(RECORD_TOE_EDGE, SOURCE_FOOT_CONTROLLER, data.footButton, data.buttonValue);
+    flightRecord(RECORD_WRIST_INPUT, SOURCE_FOOT_CONTROLLER, data.pitchValue * 1000, data.yawValue * 1000);
+    lastRecordedData = data;
+    radioControlInput();
+  }
+  // Holding a tilt keeps the hand active even though the payload stays the same
+  if (data.pitchValue != 0 || data.yawValue != 0) radioControlInput();
 
   //Button Message
-  ButtonAssign(data.footButton,data.buttonValue);
+  if (data.pressureMode) {
+    PressureAssign(data.toePressure, SOURCE_FOOT_CONTROLLER);
+  } else {
+    ButtonAssign(data.footButton,data.buttonValue, false);
+  }
 
   //Rotation Message
   if (data.pitchValue < 0) {
@@ -276,9 +384,8 @@ void readBleMessages(payloadStruct data) {
 
 /**
   Setting up the server
-    ToDo: Add a way to turn on and off the server on command
-     -WiFi.softAPdisconnect(wifioff)
-     -https://arduino-esp8266.readthedocs.io/en/latest/esp8266wifi/soft-access-point-class.html
+    The soft AP is started here so the server has a network to run on, radioCoexBegin() turns it off again
+    until it is turned on for maintenance (see radioCoexistence.h)
 */
 
 void esp32ServerStart(void) {
@@ -288,7 +395,7 @@ void esp32ServerStart(void) {
   Serial.println("Configuring access point...");
 
   // You can remove the password parameter if you want the AP to be open.
-  if (!WiFi.softAP(ssid, password)) {
+  if (!WiFi.softAP(ssid, password, RADIO_CHANNEL)) {
     log_e("Soft AP creation failed.");
     while (1)
       ;
@@ -310,7 +417,14 @@ void esp32ServerStart(void) {
     //Serial.println("Root Exists");
   });
 
+  // Probe timings, heap, stacks and loop rate
+  server.on("/metrics", HTTP_GET, profileMetrics);
+
+  // Download the last saved flight recording
+  server.on("/recording", HTTP_GET, flightRecorderDownload);
+
   ElegantOTA.begin(&server);
+  otaServerStart();
   WebSerial.begin(&server);
   WebSerial.msgCallback(webSerialMessage);
   server.begin();
@@ -332,5 +446,88 @@ void webSerialMessage(uint8_t *data, size_t len) {
   WebSerial.println(Data);
   if (Data == "LED ON") digitalWrite(LED_BUILTIN, HIGH);
   if (Data == "LED OFF") digitalWrite(LED_BUILTIN, LOW);
-  if (Data == "Restart Arm") resetFunc();
+  if (Data == "Save Recording") WebSerial.println(flightRecorderSave(0) ? "Recording Saved" : "Recording Not Saved");
+  if (Data == "Restart Arm") {
+    flightRecorderSave(0);
+    // A software restart, so the next boot does not take it for a fault
+    ESP.restart();
+  }
+  if (Data == "Servo Skew") printServoSkew();
+  if (Data == "Servo Benchmark") printServoBenchmark();
+  if (Data == "Radio Stats") printRadioStats();
+  if (Data == "Power Stats") printPowerStats();
+  if (Data == "Maintenance On") setSoftAPEnabled(true);
+  if (Data == "Maintenance Off") setSoftAPEnabled(false);
+  if (Data == "Pressure Velocity" || Data == "Pressure Target") {
+    PressureGripMode mode = Data == "Pressure Target" ? PRESSURE_GRIP_TARGET : PRESSURE_GRIP_VELOCITY;
+    portENTER_CRITICAL(&toePressureLock);
+    toePressureMapper.mode = mode;
+    portEXIT_CRITICAL(&toePressureLock);
+  }
+  if (Data == "Preshape On") handPreshaper.enabled = true;
+  if (Data == "Preshape Off") {
+    handPreshaper.enabled = false;
+    handPreshaper.cancel();
+  }
+  if (Data == "Radio Balanced") setRadioPolicy(RADIO_POLICY_BALANCED);
+  if (Data == "Radio Throttle") setRadioPolicy(RADIO_POLICY_THROTTLE_AP);
+  if (Data == "Radio Suspend") setRadioPolicy(RADIO_POLICY_SUSPEND_AP);
+}
+
+
+/**
+  Prints how long the servo output stage takes to commit a tick and how far apart the joints start moving.
+  The measured skew is the configured stagger plus a whole period for commits that crossed a period start.
+ */
+void printServoSkew() {
+  ServoSkewStats stats = servoSchedule.getStats();
+  WebSerial.print("Commits: ");
+  WebSerial.println(stats.commits);
+  WebSerial.print("Split Commits: ");
+  WebSerial.println(stats.splitCommits);
+  WebSerial.print("Commit us (last/max): ");
+  WebSerial.print(stats.lastCommitUS);
+  WebSerial.print(" / ");
+  WebSerial.println(stats.maxCommitUS);
+  WebSerial.print("Tick To Pulse us (first/last joint): ");
+  WebSerial.print(stats.tickToPulseMinUS);
+  WebSerial.print(" / ");
+  WebSerial.println(stats.tickToPulseMaxUS);
+  WebSerial.print("Configured Stagger us: ");
+  WebSerial.println(servoSchedule.configuredSpreadUS());
+  WebSerial.print("Measured Joint Skew us (last/max): ");
+  WebSerial.print(stats.jointSkewUS);
+  WebSerial.print(" / ");
+  WebSerial.println(stats.maxJointSkewUS);
+}
+
+/**
+  Times the two ways a joint is staged on this CPU: write() with an angle, like the wrist and the grips before the
+  calibration tables, and writePosition() through a calibration table. Both stage into a scratch schedule so no
+  servo moves.
+ */
+void printServoBenchmark() {
+  const int calls = 1810;
+  static int degrees[181];
+  static float positions[181];
+  for (int i = 0; i <= 180; i++) {
+    degrees[i] = i;
+    positions[i] = i / 180.0f;
+  }
+  ServoSchedule scratch;
+
+  uint32_t startCycles = ESP.getCycleCount();
+  for (int i = 0; i < calls; i++) scratch.stage(JOINT_INDEX, ServoSchedule::degreesToPulseUS(degrees[i % 181]));
+  uint32_t writeCycles = ESP.getCycleCount() - startCycles;
+
+  startCycles = ESP.getCycleCount();
+  for (int i = 0; i < calls; i++) scratch.stage(JOINT_INDEX, jointPulseUS(indexTable, positions[i % 181]));
+  uint32_t writePositionCycles = ESP.getCycleCount() - startCycles;
+
+  WebSerial.print("write() cycles per call: ");
+  WebSerial.println((float)writeCycles / calls);
+  WebSerial.print("writePosition() cycles per call: ");
+  WebSerial.println((float)writePositionCycles / calls);
+  WebSerial.print("CPU MHz: ");
+  WebSerial.println(getCpuFrequencyMhz());
 }
@@ -118,6 +118,12 @@ data:image/png;base64,iVBORw0KGgoAAAANSUhEUgAAAeoAAAHlCAAAAAAfUOAzAAAABGdBTUEAAL
 
   </div>
 
+  <div class="container">
+        
+    <Button type="submit" formaction="/recording" class="serialButton">Download Recording</Button>
+
+  </div>
+
 </form>
 
 </body>
@@ -0,0 +1,430 @@
+/**
+  2023-24 Compressed OTA
+
+  Firmware update path for gzip compressed images that can pick up where an interrupted transfer stopped.
+  The image is inflated on the fly into the inactive OTA partition, and the partition is only switched once
+  the SHA-256 of the inflated image matches the one given at the start. ElegantOTA on /update still takes
+  plain images.
+
+  Making an image (Sketch > Export Compiled Binary gives ArmCode_4_9_ESPBLEBTNCombined.ino.bin):
+    gzip -9 -k ArmCode_4_9_ESPBLEBTNCombined.ino.bin
+    sha256sum ArmCode_4_9_ESPBLEBTNCombined.ino.bin
+
+  Uploading:
+    POST /ota/start?size=<gz bytes>&image=<bin bytes>&sha256=<hex>   starts, or resumes the same image
+    POST /ota/chunk?offset=<gz offset>  (body = next part of the .gz)  send pieces in order, up to OTA_QUEUE_SIZE
+      the body must go as Content-Type: application/octet-stream, otherwise it is parsed as form fields
+    GET  /ota/status                                                 offset to resume from, throughput, time to ready
+  The answer to every chunk has the offset to send from next. After a dropped connection ask /ota/status (or
+  /ota/start again) for it and keep sending from there. The arm restarts into the new image a second after the
+  last chunk is verified.
+
+  Resuming only works within one boot. The offset, the inflater window and the SHA-256 state are in RAM, so
+  after a power loss or reset the arm keeps running the old image and the upload starts over from offset 0.
+
+  Threads:
+    - The web server only copies chunk bytes into a OTA_QUEUE_SIZE queue, so it never waits on inflating or
+      on flash erases. Bytes that do not fit are not taken, the offset in the answer says where to go on.
+    - A low priority task on the other core from the control loop inflates the queue into the OTA partition
+      and checks the hash. otaLock guards the queue, otaWorkLock keeps /ota/start from resetting the
+      transfer in the middle of the task's work.
+
+  Example with curl, sending 8 KB at a time from the offset the arm asks for:
+    curl -X POST "http://4.8.6.1/ota/start?size=$(stat -c%s app.bin.gz)&image=$(stat -c%s app.bin)&sha256=$(sha256sum app.bin | cut -c1-64)"
+    while curl -s http://4.8.6.1/ota/status | grep -q receiving; do
+      OFFSET=$(curl -s http://4.8.6.1/ota/status | grep -o '"offset":[0-9]*' | cut -d: -f2)
+      tail -c +$((OFFSET + 1)) app.bin.gz | head -c 8192 | curl -s -H "Content-Type: application/octet-stream" --data-binary @- "http://4.8.6.1/ota/chunk?offset=$OFFSET"
+    done
+
+  Depends on
+  https://docs.espressif.com/projects/arduino-esp32/en/latest/api/update.html
+ */
+
+#include <Update.h>
+#include "rom/miniz.h"
+#include "mbedtls/sha256.h"
+
+enum OtaState : uint8_t {
+  OTA_IDLE = 0,
+  OTA_RECEIVING,
+  OTA_READY,   // verified, restarting into the new image
+  OTA_FAILED
+};
+
+const char *otaStateNames[] = { "idle", "receiving", "ready", "failed" };
+
+#define OTA_QUEUE_SIZE 16384
+#define OTA_WORK_SIZE 1024  // compressed bytes the task inflates at a time
+
+enum GzipHeaderStep : uint8_t {
+  GZIP_FIXED = 0,
+  GZIP_EXTRA_LENGTH,
+  GZIP_EXTRA,
+  GZIP_NAME,
+  GZIP_COMMENT,
+  GZIP_CRC,
+  GZIP_DONE
+};
+
+struct CompressedOta {
+  OtaState state = OTA_IDLE;
+  const char *error = "";
+  String sha256;                 // expected hash of the inflated image, lower case hex
+  size_t compressedSize = 0;
+  size_t compressedReceived = 0; // taken into the queue, where the client goes on from
+  size_t compressedInflated = 0; // taken out of the queue by the task
+  size_t imageSize = 0;
+  size_t imageWritten = 0;
+
+  // gzip header
+  GzipHeaderStep headerStep = GZIP_FIXED;
+  uint8_t headerBytes[10];
+  uint16_t headerCount = 0;
+  uint8_t headerFlags = 0;
+  uint16_t extraLength = 0;
+  bool inflateDone = false;
+
+  tinfl_decompressor *inflator = nullptr;
+  uint8_t *window = nullptr;     // inflate output doubles as the 32 KB back reference window
+  size_t windowOffset = 0;
+  mbedtls_sha256_context hash;
+
+  // Chunk bytes on their way from the web server to the task
+  uint8_t *queue = nullptr;
+  size_t queueHead = 0;
+  size_t queueCount = 0;
+
+  unsigned long startMS = 0;
+  unsigned long readyMS = 0;
+  unsigned long restartAt = 0;
+} compressedOta;
+
+portMUX_TYPE otaLock = portMUX_INITIALIZER_UNLOCKED;
+SemaphoreHandle_t otaWorkLock = nullptr;
+TaskHandle_t otaTask = nullptr;
+
+/**
+ * Only called while the web server cannot touch the queue, the state is not OTA_RECEIVING
+ */
+void otaFree() {
+  free(compressedOta.inflator);
+  free(compressedOta.window);
+  free(compressedOta.queue);
+  compressedOta.inflator = nullptr;
+  compressedOta.window = nullptr;
+  compressedOta.queue = nullptr;
+  mbedtls_sha256_free(&compressedOta.hash);
+}
+
+void otaSetState(OtaState state) {
+  portENTER_CRITICAL(&otaLock);
+  compressedOta.state = state;
+  portEXIT_CRITICAL(&otaLock);
+}
+
+void otaFail(const char *error) {
+  otaSetState(OTA_FAILED);
+  if (Update.isRunning()) Update.abort();
+  otaFree();
+  compressedOta.error = error;
+  WebSerial.print("OTA Failed: ");
+  WebSerial.println(error);
+}
+
+/**
+ * otaStart() with otaWorkLock held
+ */
+void otaBegin(size_t compressedSize, size_t imageSize, const String &sha256) {
+  if (compressedOta.state == OTA_RECEIVING && compressedOta.sha256 == sha256) return;
+
+  if (compressedOta.state == OTA_RECEIVING) otaFail("replaced by a new image");
+  otaFree();
+
+  compressedOta.error = "";
+  compressedOta.sha256 = sha256;
+  compressedOta.compressedSize = compressedSize;
+  compressedOta.compressedReceived = 0;
+  compressedOta.compressedInflated = 0;
+  compressedOta.queueHead = 0;
+  compressedOta.queueCount = 0;
+  compressedOta.imageSize = imageSize;
+  compressedOta.imageWritten = 0;
+  compressedOta.headerStep = GZIP_FIXED;
+  compressedOta.headerCount = 0;
+  compressedOta.extraLength = 0;
+  compressedOta.inflateDone = false;
+  compressedOta.windowOffset = 0;
+  compressedOta.startMS = millis();
+  compressedOta.readyMS = 0;
+
+  if (sha256.length() != 64) {
+    otaFail("sha256 must be 64 hex characters");
+    return;
+  }
+
+  compressedOta.inflator = (tinfl_decompressor *)malloc(sizeof(tinfl_decompressor));
+  compressedOta.window = (uint8_t *)malloc(TINFL_LZ_DICT_SIZE);
+  compressedOta.queue = (uint8_t *)malloc(OTA_QUEUE_SIZE);
+  if (!compressedOta.inflator || !compressedOta.window || !compressedOta.queue) {
+    otaFail("out of memory");
+    return;
+  }
+  tinfl_init(compressedOta.inflator);
+  mbedtls_sha256_init(&compressedOta.hash);
+  mbedtls_sha256_starts(&compressedOta.hash, 0);
+
+  if (!Update.begin(imageSize, U_FLASH)) {
+    otaFail(Update.errorString());
+    return;
+  }
+  otaSetState(OTA_RECEIVING);
+  WebSerial.println("OTA Started");
+}
+
+/**
+ * Start a new transfer. Starting the image that is already being received keeps it, so the client can resume.
+ * Waits for the task to finish the piece it is inflating.
+ */
+void otaStart(size_t compressedSize, size_t imageSize, String sha256) {
+  sha256.toLowerCase();
+  xSemaphoreTake(otaWorkLock, portMAX_DELAY);
+  otaBegin(compressedSize, imageSize, sha256);
+  xSemaphoreGive(otaWorkLock);
+}
+
+/**
+ * Next optional gzip header field the flags say is there, in the order RFC 1952 puts them
+ */
+GzipHeaderStep otaNextHeaderStep(GzipHeaderStep step) {
+  uint8_t flags = compressedOta.headerFlags;
+  if (step < GZIP_EXTRA_LENGTH && (flags & 0x04)) return GZIP_EXTRA_LENGTH;
+  if (step < GZIP_NAME && (flags & 0x08)) return GZIP_NAME;
+  if (step < GZIP_COMMENT && (flags & 0x10)) return GZIP_COMMENT;
+  if (step < GZIP_CRC && (flags & 0x02)) return GZIP_CRC;
+  return GZIP_DONE;
+}
+
+/**
+ * Walk the gzip header one byte at a time, since it can be split across chunks
+ */
+void otaHeaderByte(uint8_t value) {
+  CompressedOta &ota = compressedOta;
+  GzipHeaderStep step = ota.headerStep;
+
+  switch (step) {
+    case GZIP_FIXED:
+      ota.headerBytes[ota.headerCount++] = value;
+      if (ota.headerCount < 10) return;
+      if (ota.headerBytes[0] != 0x1F || ota.headerBytes[1] != 0x8B || ota.headerBytes[2] != 8) {
+        otaFail("not a gzip image");
+        return;
+      }
+      ota.headerFlags = ota.headerBytes[3];
+      ota.headerStep = otaNextHeaderStep(GZIP_FIXED);
+      break;
+    case GZIP_EXTRA_LENGTH:
+      ota.extraLength |= value << (8 * ota.headerCount++);
+      if (ota.headerCount < 2) return;
+      ota.headerStep = ota.extraLength ? GZIP_EXTRA : otaNextHeaderStep(GZIP_EXTRA);
+      break;
+    case GZIP_EXTRA:
+      if (++ota.headerCount < ota.extraLength) return;
+      ota.headerStep = otaNextHeaderStep(GZIP_EXTRA);
+      break;
+    case GZIP_NAME:
+    case GZIP_COMMENT:
+      // Zero terminated strings
+      if (value != 0) return;
+      ota.headerStep = otaNextHeaderStep(step);
+      break;
+    case GZIP_CRC:
+      if (++ota.headerCount < 2) return;
+      ota.headerStep = otaNextHeaderStep(GZIP_CRC);
+      break;
+    case GZIP_DONE:
+      return;
+  }
+  ota.headerCount = 0;
+}
+
+/**
+ * Inflate compressed bytes straight into the OTA partition
+ */
+void otaInflate(const uint8_t *data, size_t length) {
+  CompressedOta &ota = compressedOta;
+
+  while (ota.headerStep != GZIP_DONE && length > 0 && ota.state == OTA_RECEIVING) {
+    otaHeaderByte(*data);
+    data++;
+    length--;
+  }
+
+  while (length > 0 && !ota.inflateDone && ota.state == OTA_RECEIVING) {
+    size_t inBytes = length;
+    size_t outBytes = TINFL_LZ_DICT_SIZE - ota.windowOffset;
+    tinfl_status status = tinfl_decompress(ota.inflator, data, &inBytes, ota.window, ota.window + ota.windowOffset, &outBytes, TINFL_FLAG_HAS_MORE_INPUT);
+    data += inBytes;
+    length -= inBytes;
+
+    if (outBytes > 0) {
+      if (Update.write(ota.window + ota.windowOffset, outBytes) != outBytes) {
+        otaFail(Update.errorString());
+        return;
+      }
+      mbedtls_sha256_update(&ota.hash, ota.window + ota.windowOffset, outBytes);
+      ota.imageWritten += outBytes;
+      ota.windowOffset = (ota.windowOffset + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+    }
+
+    if (status == TINFL_STATUS_DONE) ota.inflateDone = true;
+    else if (status < TINFL_STATUS_DONE) otaFail("corrupt gzip data");
+    else if (inBytes == 0 && outBytes == 0) break;
+  }
+}
+
+/**
+ * Check the inflated image and switch the boot partition to it
+ */
+void otaFinish() {
+  CompressedOta &ota = compressedOta;
+
+  uint8_t digest[32];
+  mbedtls_sha256_finish(&ota.hash, digest);
+  char hex[65];
+  for (int i = 0; i < 32; i++) sprintf(hex + 2 * i, "%02x", digest[i]);
+
+  if (!ota.inflateDone || ota.imageWritten != ota.imageSize) {
+    otaFail("image size does not match");
+    return;
+  }
+  if (ota.sha256 != hex) {
+    otaFail("sha256 does not match");
+    return;
+  }
+  if (!Update.end()) {
+    otaFail(Update.errorString());
+    return;
+  }
+
+  ota.readyMS = millis();
+  ota.restartAt = ota.readyMS + 1000;
+  otaSetState(OTA_READY);
+  otaFree();
+  WebSerial.print("OTA Ready in ms: ");
+  WebSerial.println(ota.readyMS - ota.startMS);
+}
+
+/**
+ * Body handler for POST /ota/chunk, called for every piece of the request body as it arrives. Only queues the
+ * bytes for otaTaskLoop().
+ */
+void otaChunkBody(AsyncWebServerRequest *request, uint8_t *data, size_t length, size_t index, size_t total) {
+  CompressedOta &ota = compressedOta;
+  if (!request->hasParam("offset")) return;
+  size_t offset = request->getParam("offset")->value().toInt() + index;
+
+  portENTER_CRITICAL(&otaLock);
+  // Skip anything the arm already has, a gap means the client is ahead and has to resume from our offset
+  size_t skip = ota.compressedReceived - offset;
+  size_t taken = 0;
+  if (ota.state == OTA_RECEIVING && offset <= ota.compressedReceived && skip < length) {
+    taken = min(min(length - skip, (size_t)OTA_QUEUE_SIZE - ota.queueCount), ota.compressedSize - ota.compressedReceived);
+    size_t tail = (ota.queueHead + ota.queueCount) % OTA_QUEUE_SIZE;
+    size_t firstSpan = min(taken, (size_t)OTA_QUEUE_SIZE - tail);
+    memcpy(ota.queue + tail, data + skip, firstSpan);
+    memcpy(ota.queue, data + skip + firstSpan, taken - firstSpan);
+    ota.queueCount += taken;
+    ota.compressedReceived += taken;
+  }
+  portEXIT_CRITICAL(&otaLock);
+
+  if (taken) xTaskNotifyGive(otaTask);
+}
+
+/**
+ * Inflates the next piece of the queue, and checks the image once all of it went through
+ */
+void otaWork() {
+  static uint8_t piece[OTA_WORK_SIZE];
+  CompressedOta &ota = compressedOta;
+
+  portENTER_CRITICAL(&otaLock);
+  size_t length = ota.state == OTA_RECEIVING ? min(ota.queueCount, (size_t)OTA_WORK_SIZE) : 0;
+  size_t firstSpan = min(length, (size_t)OTA_QUEUE_SIZE - ota.queueHead);
+  if (length) {
+    memcpy(piece, ota.queue + ota.queueHead, firstSpan);
+    memcpy(piece + firstSpan, ota.queue, length - firstSpan);
+    ota.queueHead = (ota.queueHead + length) % OTA_QUEUE_SIZE;
+    ota.queueCount -= length;
+  }
+  portEXIT_CRITICAL(&otaLock);
+  if (!length) return;
+
+  otaInflate(piece, length);
+  ota.compressedInflated += length;
+  if (ota.state == OTA_RECEIVING && ota.compressedInflated >= ota.compressedSize) otaFinish();
+}
+
+void otaTaskLoop(void *parameter) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+    while (compressedOta.state == OTA_RECEIVING && compressedOta.queueCount > 0) {
+      xSemaphoreTake(otaWorkLock, portMAX_DELAY);
+      otaWork();
+      xSemaphoreGive(otaWorkLock);
+    }
+  }
+}
+
+void otaSendStatus(AsyncWebServerRequest *request) {
+  CompressedOta &ota = compressedOta;
+  unsigned long elapsedMS = (ota.readyMS ? ota.readyMS : millis()) - ota.startMS;
+
+  String json = "{\"state\":\"";
+  json += otaStateNames[ota.state];
+  json += "\",\"offset\":";
+  json += String(ota.compressedReceived);
+  json += ",\"size\":";
+  json += String(ota.compressedSize);
+  json += ",\"imageWritten\":";
+  json += String(ota.imageWritten);
+  json += ",\"imageSize\":";
+  json += String(ota.imageSize);
+  json += ",\"kBps\":";
+  json += String(elapsedMS ? (float)ota.compressedReceived / elapsedMS : 0);
+  json += ",\"imageKBps\":";
+  json += String(elapsedMS ? (float)ota.imageWritten / elapsedMS : 0);
+  json += ",\"timeToReadyMS\":";
+  json += String(ota.readyMS ? ota.readyMS - ota.startMS : 0);
+  json += ",\"error\":\"";
+  json += ota.error;
+  json += "\"}";
+  request->send(ota.state == OTA_FAILED ? 500 : 200, "application/json", json);
+}
+
+void otaServerStart() {
+  // Below the web server and on the core the control loop is not on
+  otaWorkLock = xSemaphoreCreateMutex();
+  xTaskCreatePinnedToCore(otaTaskLoop, "ota", 4096, nullptr, 1, &otaTask, 0);
+
+  server.on("/ota/start", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (!request->hasParam("size") || !request->hasParam("image") || !request->hasParam("sha256")) {
+      request->send(400, "text/plain", "size, image and sha256 are required");
+      return;
+    }
+    otaStart(request->getParam("size")->value().toInt(), request->getParam("image")->value().toInt(), request->getParam("sha256")->value());
+    otaSendStatus(request);
+  });
+
+  server.on("/ota/chunk", HTTP_POST, otaSendStatus, nullptr, otaChunkBody);
+  server.on("/ota/status", HTTP_GET, otaSendStatus);
+}
+
+/**
+ * Restarts into the new image once it is ready, call it from the main loop
+ */
+void otaLoop() {
+  if (compressedOta.state == OTA_READY && (long)(millis() - compressedOta.restartAt) >= 0) {
+    ESP.restart();
+  }
+}
@@ -0,0 +1,49 @@
+/**
+  2023-24 Flight Recording Format
+
+  Layout of a flight recording (little endian), the same in flash, in the /recording download and in the
+  host tools:
+    FlightRecordingHeader, then recordCount FlightRecord entries, oldest first.
+    Timestamps are micros() and wrap around every ~71 minutes.
+
+  Nothing in here touches the hardware, so the host tools include it as it is.
+ */
+
+#include <stdint.h>
+
+#define FLIGHT_RECORDER_MAGIC 0x43455246  // "FREC"
+#define FLIGHT_RECORDER_VERSION 1
+
+enum FlightRecordType : uint8_t {
+  RECORD_BOOT = 1,     // b = esp_reset_reason() of this boot
+  RECORD_TOE_EDGE,     // a = toe, b = button value. In pressure mode only the virtual presses, from SOURCE_ARM
+  RECORD_WRIST_INPUT,  // a = pitch * 1000, b = yaw * 1000
+  RECORD_GESTURE,      // a = ToeGestureAction, b = decision latency ms
+  RECORD_MODE,         // a = fingerType, b = wristLocked
+  RECORD_SERVO,        // source = ServoJoint, a = pulse width us
+  RECORD_LINK,         // a = 1 connected, 0 disconnected
+  RECORD_TOE_PRESSURE  // a = toe, b = pressure 0 to 255, only when it changed
+};
+
+enum FlightRecordSource : uint8_t {
+  SOURCE_ARM = 0,
+  SOURCE_FOOT_SLEEVE,      // ESP-NOW
+  SOURCE_FOOT_CONTROLLER   // BLE
+};
+
+struct FlightRecord {
+  uint32_t timeUS;
+  uint8_t type;
+  uint8_t source;
+  int16_t a;
+  int32_t b;
+};
+
+struct FlightRecordingHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize;
+  uint32_t recordCount;
+  uint32_t resetReason;  // what caused the reset that made this recording get saved, 0 when saved on command
+  uint32_t droppedRecords;
+};
@@ -0,0 +1,189 @@
+/**
+  2023-24 Flight Recorder
+
+  Keeps the last FLIGHT_RECORDER_SIZE input events, gestures and servo commands in a RAM ring buffer so we can
+  find out what the arm did when something goes wrong in the field.
+    - The ring lives in no-init RAM, so it survives a panic or watchdog reset. It is saved to the "flightrec"
+      flash partition (see partitions.csv) on the next boot when the arm was reset by a fault.
+    - A brownout can flip bits in that RAM, so the ring keeps a check of every record it holds. After any fault
+      the ring is only saved if the check still matches, a corrupted ring is thrown away.
+    - Servo outputs are recorded at most every FLIGHT_RECORDER_SERVO_MS per joint while the hand moves, ending
+      with the pulse each joint stops at. That is at most 80 servo records a second for the 8 joints, so the ring
+      holds about the last 25 s of a hand that never stops moving, and minutes of normal use, with the gestures
+      and links that led up to a fault.
+    - "Save Recording" on the WebSerial page saves it on command. "Restart Arm" saves it before restarting.
+    - The saved recording is downloaded from http://4.8.6.1/recording
+
+  The recording layout is in flightRecordFormat.h, the same in flash and in the download. tools/flightReplay
+  reads a downloaded recording on a computer and replays it through the gesture recognizer.
+
+  Depends on
+  https://docs.espressif.com/projects/esp-idf/en/v4.4/esp32/api-reference/storage/spi_flash.html
+ */
+
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_partition.h>
+#include "flightRecordFormat.h"
+
+#define FLIGHT_RECORDER_SIZE 2048
+#define FLIGHT_RECORDER_SERVO_MS 100
+
+struct FlightRecorderRing {
+  uint32_t magic;
+  uint32_t head;   // next slot to write
+  uint32_t count;
+  uint32_t dropped;
+  uint32_t check;  // flightRecordCheck() of every slot XORed together, kept up to date by flightRecord()
+  FlightRecord records[FLIGHT_RECORDER_SIZE];
+};
+
+__NOINIT_ATTR FlightRecorderRing flightRecorderRing;
+portMUX_TYPE flightRecorderLock = portMUX_INITIALIZER_UNLOCKED;
+bool flightRecorderPaused = false;
+
+/**
+ * Mixes the words of one record, so that the same bit flipped in two words does not cancel out
+ */
+uint32_t flightRecordCheck(const FlightRecord &record) {
+  uint32_t words[sizeof(FlightRecord) / 4];
+  memcpy(words, &record, sizeof(words));
+  uint32_t check = 0;
+  for (size_t i = 0; i < sizeof(words) / 4; i++) check ^= (words[i] << (i * 11)) | (words[i] >> ((32 - i * 11) % 32));
+  return check;
+}
+
+uint32_t flightRecorderRingCheck() {
+  uint32_t check = 0;
+  for (int i = 0; i < FLIGHT_RECORDER_SIZE; i++) check ^= flightRecordCheck(flightRecorderRing.records[i]);
+  return check;
+}
+
+/**
+ * Add one record to the ring. Safe to call from the ESP-NOW callback.
+ */
+void flightRecord(uint8_t type, uint8_t source, int16_t a, int32_t b) {
+  portENTER_CRITICAL(&flightRecorderLock);
+  if (flightRecorderPaused) {
+    flightRecorderRing.dropped++;
+    portEXIT_CRITICAL(&flightRecorderLock);
+    return;
+  }
+
+  FlightRecord &record = flightRecorderRing.records[flightRecorderRing.head];
+  flightRecorderRing.check ^= flightRecordCheck(record);
+  record.timeUS = micros();
+  record.type = type;
+  record.source = source;
+  record.a = a;
+  record.b = b;
+  flightRecorderRing.check ^= flightRecordCheck(record);
+
+  flightRecorderRing.head = (flightRecorderRing.head + 1) % FLIGHT_RECORDER_SIZE;
+  if (flightRecorderRing.count < FLIGHT_RECORDER_SIZE) flightRecorderRing.count++;
+  portEXIT_CRITICAL(&flightRecorderLock);
+}
+
+const esp_partition_t *flightRecorderPartition() {
+  return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "flightrec");
+}
+
+/**
+ * Write the ring to the flash partition, oldest record first
+ * @param resetReason stored in the header, 0 when saved on command
+ * @returns false if there is no partition or the write failed
+ */
+bool flightRecorderSave(uint32_t resetReason) {
+  const esp_partition_t *partition = flightRecorderPartition();
+  if (partition == NULL) return false;
+
+  // Stop recording while the ring is copied out, anything that comes in meanwhile is counted as dropped
+  portENTER_CRITICAL(&flightRecorderLock);
+  flightRecorderPaused = true;
+  portEXIT_CRITICAL(&flightRecorderLock);
+
+  FlightRecordingHeader header;
+  header.magic = FLIGHT_RECORDER_MAGIC;
+  header.version = FLIGHT_RECORDER_VERSION;
+  header.recordSize = sizeof(FlightRecord);
+  header.recordCount = flightRecorderRing.count;
+  header.resetReason = resetReason;
+  header.droppedRecords = flightRecorderRing.dropped;
+
+  size_t length = sizeof(header) + header.recordCount * sizeof(FlightRecord);
+  size_t eraseLength = (length + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+  uint32_t oldest = (flightRecorderRing.head + FLIGHT_RECORDER_SIZE - flightRecorderRing.count) % FLIGHT_RECORDER_SIZE;
+  uint32_t firstSpan = min((uint32_t)(FLIGHT_RECORDER_SIZE - oldest), header.recordCount);
+
+  bool saved = eraseLength <= partition->size
+               && esp_partition_erase_range(partition, 0, eraseLength) == ESP_OK
+               && esp_partition_write(partition, 0, &header, sizeof(header)) == ESP_OK
+               && esp_partition_write(partition, sizeof(header), &flightRecorderRing.records[oldest], firstSpan * sizeof(FlightRecord)) == ESP_OK
+               && (firstSpan == header.recordCount
+                   || esp_partition_write(partition, sizeof(header) + firstSpan * sizeof(FlightRecord), &flightRecorderRing.records[0], (header.recordCount - firstSpan) * sizeof(FlightRecord)) == ESP_OK);
+
+  portENTER_CRITICAL(&flightRecorderLock);
+  flightRecorderPaused = false;
+  portEXIT_CRITICAL(&flightRecorderLock);
+  return saved;
+}
+
+/**
+ * Should be called first thing in setup. Saves what the previous run recorded if it ended in a fault, then starts a new recording.
+ */
+void flightRecorderBegin() {
+  esp_reset_reason_t reason = esp_reset_reason();
+  bool fault = reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT || reason == ESP_RST_WDT || reason == ESP_RST_BROWNOUT;
+  bool ringValid = flightRecorderRing.magic == FLIGHT_RECORDER_MAGIC && flightRecorderRing.head < FLIGHT_RECORDER_SIZE && flightRecorderRing.count <= FLIGHT_RECORDER_SIZE;
+
+  if (fault && ringValid && flightRecorderRingCheck() != flightRecorderRing.check) {
+    Serial.println("Flight recording corrupted by the reset, not saved");
+  } else if (fault && ringValid) {
+    Serial.println(flightRecorderSave(reason) ? "Flight recording saved after fault" : "Flight recording could not be saved");
+  }
+
+  flightRecorderRing.magic = FLIGHT_RECORDER_MAGIC;
+  flightRecorderRing.head = 0;
+  flightRecorderRing.count = 0;
+  flightRecorderRing.dropped = 0;
+  flightRecorderRing.check = flightRecorderRingCheck();
+  flightRecord(RECORD_BOOT, SOURCE_ARM, 0, reason);
+}
+
+/**
+ * Record the joints whose pulse width changed since they were last recorded, each at most every
+ * FLIGHT_RECORDER_SERVO_MS. A joint that stops is recorded at the pulse it stopped at within that time.
+ */
+void flightRecordServoOutputs() {
+  static uint16_t recordedPulseUS[SERVO_JOINT_COUNT];
+  static unsigned long recordedAt[SERVO_JOINT_COUNT];
+  unsigned long now = millis();
+  for (int joint = 0; joint < SERVO_JOINT_COUNT; joint++) {
+    uint16_t pulseUS = servoSchedule.getPulseUS(joint);
+    if (pulseUS == recordedPulseUS[joint] || now - recordedAt[joint] < FLIGHT_RECORDER_SERVO_MS) continue;
+    flightRecord(RECORD_SERVO, joint, pulseUS, 0);
+    recordedPulseUS[joint] = pulseUS;
+    recordedAt[joint] = now;
+  }
+}
+
+/**
+ * GET /recording, streams the saved recording straight out of flash
+ */
+void flightRecorderDownload(AsyncWebServerRequest *request) {
+  const esp_partition_t *partition = flightRecorderPartition();
+  FlightRecordingHeader header;
+  if (partition == NULL || esp_partition_read(partition, 0, &header, sizeof(header)) != ESP_OK || header.magic != FLIGHT_RECORDER_MAGIC) {
+    request->send(404, "text/plain", "No recording saved");
+    return;
+  }
+
+  size_t length = sizeof(header) + header.recordCount * header.recordSize;
+  AsyncWebServerResponse *response = request->beginResponse("application/octet-stream", length, [partition, length](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+    size_t chunk = min(maxLen, length - index);
+    if (esp_partition_read(partition, index, buffer, chunk) != ESP_OK) return 0;
+    return chunk;
+  });
+  response->addHeader("Content-Disposition", "attachment; filename=\"flightrec.bin\"");
+  request->send(response);
+}
@@ -0,0 +1,88 @@
+/**
+  2023-24 Hand Configuration
+
+  The toe gestures, grip steps, pre-shaping poses and joint calibration of the arm. Nothing in here touches the
+  hardware, so the host tools in /tools and the tests in /tests run exactly what the arm runs. Needs
+  toeGestures.h and jointCalibration.h included before it.
+ */
+
+/**
+ Toe Gestures:
+  - Each row is one gesture, the steps it is made of, what it does and the name printed when it fires.
+  - None of the default gestures is the start of another one, so all of them fire on the release that completes them.
+  - Tapping the same toe twice is how a grip is tightened or loosened a little more, so it is not a gesture. Taps of
+    different toes, chords and sequences are free to add. A hold on the big or small toe also drives gripping and
+    releasing, so think twice before mapping one.
+  - Both toes together fire on the release, so the same chord held down can be a different gesture. Holding both toes grips and releases at once, the hand stays where it is.
+  - Holding both toes and then pressing both goes back to the full grip, holding both toes twice turns the maintenance soft AP on or off (see radioCoexistence.h).
+*/
+const ToeGestureRule toeGestureTable[] = {
+  { { STEP_TAP_BIG, STEP_TAP_SMALL }, ACTION_NEXT_MODE, 0, "Big Then Small Toes" },
+  { { STEP_TAP_SMALL, STEP_TAP_BIG }, ACTION_NEXT_MODE, 0, "Small Toes Then Big" },
+  { { STEP_CHORD }, ACTION_WRIST_LOCK, 0, "Both Toes" },
+  { { STEP_HOLD_CHORD, STEP_CHORD }, ACTION_SET_MODE, 0, "Both Toes Held Then Both" },
+  { { STEP_HOLD_CHORD, STEP_HOLD_CHORD }, ACTION_MAINTENANCE, 0, "Both Toes Held Twice" },
+};
+const int toeGestureCount = sizeof(toeGestureTable) / sizeof(toeGestureTable[0]);
+
+/**
+ Grips:
+  - Positions are 0 = open, 1 = closed. Every pass of a grip or release moves the fingers by @param fingerStep and the thumb by @param thumbStep, times the grip speed.
+  - The thumb base starts a grip at @param thumbBaseDefault, or wherever it was pre-shaped to, and turns into the palm by @param thumbBaseStep per pass up to the pose's maximum.
+*/
+float fingerStep = 5.0 / 160;
+float thumbStep = 2.0 / 80;
+float thumbBaseStep = 1.0 / 90;
+float thumbBaseDefault = 0.33;
+float thumbBaseGripMax = 0;
+float thumbBasePinchMax = 0.44;
+float thumbBaseTripodMax = 0.67;
+float thumbBasePointMax = 1;
+
+/**
+ Pre-Shaping (see handPreshape.h):
+  - One row per finger mode, in @param fingerType order. Positions are the same as the grips use, 0 = open, 1 = closed.
+  - Leave the joints a grip drives on PRESHAPE_KEEP, except for the thumb base. The grips carry on from wherever the thumb base was pre-shaped to, so keep its ready position between @param thumbBaseDefault and the pose's thumbBase_POSE_Max.
+  - A joint nothing has written yet glides from its @param handRestPosition, the open hand.
+  - Grip and Pinch are not pre-shaped. Their grips reach the object before their thumb base could gain anything, so a
+    ready posture only moves servos and draws current (see tests/handPreshapeTest.cpp). Tripod saves about 110 ms of
+    the 320 ms grip when the big toe comes 750 ms after the mode change and 150 ms from 1 s on, Point 110 ms and 250 ms
+    of 620 ms.
+*/
+#define PRESHAPE_KEEP -1
+
+struct PreshapePose {
+  const char *name;
+  float readyPosition[SERVO_JOINT_COUNT];  // indexed by ServoJoint
+};
+
+const PreshapePose preshapePoses[] = {
+  //             thumb          thumbBase      index          middle         ring           pinky          rotation       bending
+  { "Grip",   { PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP } },
+  { "Pinch",  { PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP } },
+  { "Tripod", { PRESHAPE_KEEP, 0.5,           PRESHAPE_KEEP, PRESHAPE_KEEP, 0,             0,             PRESHAPE_KEEP, PRESHAPE_KEEP } },
+  { "Point",  { PRESHAPE_KEEP, 0.67,          0,             PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP } },
+};
+
+//                                                 thumb thumbBase index middle ring pinky rotation       bending
+const float handRestPosition[SERVO_JOINT_COUNT] = { 0,    0,        0,    0,     0,   0,    PRESHAPE_KEEP, PRESHAPE_KEEP };
+
+/**
+ Joint Calibration:
+  - Pulse widths at the open (0) and closed (1) position of every finger joint, turned into lookup tables when compiling (see jointCalibration.h). Add points in between for a joint that does not move evenly, e.g. { 0.5, 1500 }.
+  - The ring and pinky servos are mounted the other way round, so they close with a longer pulse while the index and middle close with a shorter one.
+  - The thumb only closes down to 80 degrees. The thumb base turns up to 90 degrees into the palm.
+*/
+constexpr CalibrationPoint thumbCalibration[] = { { 0, calibrationDegreesUS(160) }, { 1, calibrationDegreesUS(80) } };
+constexpr CalibrationPoint thumbBaseCalibration[] = { { 0, calibrationDegreesUS(0) }, { 1, calibrationDegreesUS(90) } };
+constexpr CalibrationPoint indexCalibration[] = { { 0, calibrationDegreesUS(160) }, { 1, calibrationDegreesUS(0) } };
+constexpr CalibrationPoint middleCalibration[] = { { 0, calibrationDegreesUS(160) }, { 1, calibrationDegreesUS(0) } };
+constexpr CalibrationPoint ringCalibration[] = { { 0, calibrationDegreesUS(0) }, { 1, calibrationDegreesUS(160) } };
+constexpr CalibrationPoint pinkCalibration[] = { { 0, calibrationDegreesUS(0) }, { 1, calibrationDegreesUS(160) } };
+
+constexpr JointTable thumbTable = makeJointTable(thumbCalibration);
+constexpr JointTable thumbBaseTable = makeJointTable(thumbBaseCalibration);
+constexpr JointTable indexTable = makeJointTable(indexCalibration);
+constexpr JointTable middleTable = makeJointTable(middleCalibration);
+constexpr JointTable ringTable = makeJointTable(ringCalibration);
+constexpr JointTable pinkTable = makeJointTable(pinkCalibration);
@@ -0,0 +1,99 @@
+/**
+  2023-24 Hand Pre-Shaping
+
+  As soon as a new finger mode is picked, the next grip is known. Instead of waiting for the big toe, the
+  joints a grip does not drive and the thumb base glide to the pose's ready posture in the background, so
+  the grip itself only has to cover what is left. This replaces having to rely on thumbBaseDefault alone to
+  hide the transmission lag.
+
+  Every pose lists a ready position for each joint (0 = open, 1 = closed, see jointCalibration.h),
+  PRESHAPE_KEEP leaves a joint where it is. The poses are in handConfig.h. The glide is rate limited to
+  @param positionPerSecond and is cancelled by a grip, a release or a new mode. A joint that was never written
+  glides from its rest position, so it does not jump to the ready position on the first mode change. A pose
+  that keeps every joint leaves its mode without pre-shaping.
+ */
+
+class HandPreshaper {
+  private:
+    JointServo **joints;        // indexed by ServoJoint, nullptr for joints that are never pre-shaped
+    const float *restPosition;  // where each joint is before anything wrote it, PRESHAPE_KEEP if unknown
+    const PreshapePose *poses;
+    int poseCount;
+    float positionPerSecond;
+    float position[SERVO_JOINT_COUNT];
+    int pose = -1;              // pose being glided to, -1 when idle
+    unsigned long lastUpdateMS = 0;
+
+  public:
+    bool enabled = true;
+
+    HandPreshaper(JointServo **joints, const float *restPosition, const PreshapePose *poses, int poseCount, float positionPerSecond = 0.6)
+      : joints(joints), restPosition(restPosition), poses(poses), poseCount(poseCount), positionPerSecond(positionPerSecond) {}
+
+    /**
+     * Start gliding to the ready posture of a pose, replacing any glide in progress
+     */
+    void start(int newPose, unsigned long now) {
+      if (!enabled || newPose < 0 || newPose >= poseCount) {
+        cancel();
+        return;
+      }
+      pose = newPose;
+      lastUpdateMS = now;
+      bool anyDriven = false;
+      for (int joint = 0; joint < SERVO_JOINT_COUNT; joint++) {
+        position[joint] = joints[joint] ? joints[joint]->readPosition() : -1;
+        if (position[joint] < 0) position[joint] = restPosition[joint];
+        if (drives(joint)) anyDriven = true;
+      }
+      if (!anyDriven) cancel();
+    }
+
+    void cancel() { pose = -1; }
+    bool isActive() { return pose >= 0; }
+    int getPose() { return pose; }
+
+    /**
+     * @returns true when the pose being glided to moves this joint
+     */
+    bool drives(uint8_t joint) {
+      return pose >= 0 && joint < SERVO_JOINT_COUNT && joints[joint] && poses[pose].readyPosition[joint] != PRESHAPE_KEEP;
+    }
+
+    float getPosition(uint8_t joint) { return joint < SERVO_JOINT_COUNT ? position[joint] : -1; }
+
+    void setRate(float newPositionPerSecond) { positionPerSecond = newPositionPerSecond; }
+    float getRate() { return positionPerSecond; }
+
+    /**
+     * Move every pre-shaped joint one rate limited step closer to its ready position
+     * @returns true while some joint is still on its way
+     */
+    bool update(unsigned long now) {
+      if (pose < 0) return false;
+
+      float maxStep = positionPerSecond * (now - lastUpdateMS) / 1000.0;
+      lastUpdateMS = now;
+
+      bool moving = false;
+      for (int joint = 0; joint < SERVO_JOINT_COUNT; joint++) {
+        if (!drives(joint)) continue;
+        float target = poses[pose].readyPosition[joint];
+
+        if (position[joint] < 0) {
+          // Never written and no rest position, there is nothing to glide from
+          position[joint] = target;
+        } else if (position[joint] < target) {
+          position[joint] = position[joint] + maxStep < target ? position[joint] + maxStep : target;
+        } else if (position[joint] > target) {
+          position[joint] = position[joint] - maxStep > target ? position[joint] - maxStep : target;
+        }
+
+        joints[joint]->writePosition(position[joint]);
+        if (position[joint] != target) moving = true;
+      }
+
+      if (!moving) pose = -1;
+      return moving;
+    }
+};
@@ -0,0 +1,100 @@
+/**
+  2023-24 Joint Calibration
+
+  Maps a normalized joint position (0 = open, 1 = closed) to the pulse width that puts that joint there.
+  Every joint gets its own lookup table, so a servo mounted the other way round or a tendon that does not
+  pull evenly is handled by the table instead of by the grip code.
+
+  A joint is described by calibration points, pulse widths measured at positions from open to closed.
+  Two points give a straight line, more points in between compensate a joint that moves unevenly. A joint
+  that closes with a shorter pulse just lists falling pulse widths. The points are resampled into a
+  JOINT_TABLE_SIZE entry table while compiling, so the control loop only does one interpolation between two
+  table entries and writes microseconds straight to the servo output stage.
+
+  Nothing in here touches the hardware, so it can be compiled on a host. Include servoSchedule.h first, it has
+  the pulse range.
+ */
+
+#include <stdint.h>
+
+#define JOINT_TABLE_SIZE 17  // 16 segments
+
+struct CalibrationPoint {
+  float position;
+  uint16_t pulseUS;
+};
+
+struct JointTable {
+  uint16_t pulseUS[JOINT_TABLE_SIZE];
+};
+
+/**
+ * Pulse width of a servo angle, the same conversion as ServoSchedule::degreesToPulseUS() but usable in a table
+ */
+constexpr uint16_t calibrationDegreesUS(int degrees) {
+  return SERVO_MIN_PULSE_US + (long)degrees * (SERVO_MAX_PULSE_US - SERVO_MIN_PULSE_US) / 180;
+}
+
+/**
+ * Pulse width at a position, interpolated between the two calibration points around it. Positions outside
+ * the points follow the first or last segment.
+ */
+constexpr uint16_t interpolateCalibration(const CalibrationPoint *points, int count, float position, int i = 0) {
+  return (i >= count - 2 || position <= points[i + 1].position)
+    ? (uint16_t)(points[i].pulseUS
+                 + ((float)points[i + 1].pulseUS - points[i].pulseUS) * (position - points[i].position) / (points[i + 1].position - points[i].position)
+                 + 0.5f)
+    : interpolateCalibration(points, count, position, i + 1);
+}
+
+template <int... I> struct JointTableIndices {};
+template <int N, int... I> struct MakeJointTableIndices : MakeJointTableIndices<N - 1, N - 1, I...> {};
+template <int... I> struct MakeJointTableIndices<0, I...> { typedef JointTableIndices<I...> type; };
+
+template <int... I>
+constexpr JointTable buildJointTable(const CalibrationPoint *points, int count, JointTableIndices<I...>) {
+  return JointTable{ { interpolateCalibration(points, count, (float)I / (JOINT_TABLE_SIZE - 1))... } };
+}
+
+/**
+ * Build a joint table from at least two calibration points, sorted from open to closed
+ */
+template <int N>
+constexpr JointTable makeJointTable(const CalibrationPoint (&points)[N]) {
+  static_assert(N >= 2, "A joint needs at least an open and a closed calibration point");
+  return buildJointTable(points, N, typename MakeJointTableIndices<JOINT_TABLE_SIZE>::type());
+}
+
+/**
+ * Pulse width for a position, clamped to 0 (open) and 1 (closed)
+ */
+inline uint16_t jointPulseUS(const JointTable &table, float position) {
+  if (position <= 0) return table.pulseUS[0];
+  if (position >= 1) return table.pulseUS[JOINT_TABLE_SIZE - 1];
+
+  float scaled = position * (JOINT_TABLE_SIZE - 1);
+  int segment = (int)scaled;
+  int from = table.pulseUS[segment];
+  int to = table.pulseUS[segment + 1];
+  return from + (int)((to - from) * (scaled - segment));
+}
+
+/**
+ * Position a pulse width puts a joint at, the inverse of jointPulseUS(). The host tools use it to read the servo
+ * records of a flight recording.
+ */
+inline float jointPosition(const JointTable &table, uint16_t pulseUS) {
+  for (int segment = 0; segment < JOINT_TABLE_SIZE - 1; segment++) {
+    int from = table.pulseUS[segment];
+    int to = table.pulseUS[segment + 1];
+    bool inside = from <= to ? pulseUS >= from && pulseUS <= to : pulseUS <= from && pulseUS >= to;
+    if (!inside) continue;
+    float part = from == to ? 0 : (float)(pulseUS - from) / (to - from);
+    return (segment + part) / (JOINT_TABLE_SIZE - 1);
+  }
+
+  // Past either end of the table, take the closer one
+  int open = table.pulseUS[0];
+  int closed = table.pulseUS[JOINT_TABLE_SIZE - 1];
+  return (pulseUS - open) * (pulseUS - open) <= (pulseUS - closed) * (pulseUS - closed) ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+/**
+  2023-24 Power Management
+
+  The arm counts as idle once no foot input has arrived for @param powerIdleAfterMS. A held toe or tilt
+  counts as input, so a grip that is being held never goes idle.
+    - Idle: if the hand is fully released, the hand joints stop getting pulses, so their servos stop holding
+      torque. The wrist keeps its pulses because it carries the hand. The CPU drops to @param powerIdleCpuMHz.
+      Wi-Fi is left as it is: modem sleep only saves power on a station that is associated to an access point,
+      and the arm's station never is, it only carries ESP-NOW. So the receiver keeps listening in both states.
+    - Active: the first powerLoop() after an input from OnDataRecv() or readBleMessages() restores everything
+      and commits the hand joints straight away. The BLE control tick calls it before processToeButtons(),
+      so the hand is holding again before the input moves it. The wake latency is measured from the input.
+  The soft AP stays off unless it is turned on for maintenance, see radioCoexistence.h.
+
+  The currents are estimates from the ESP32 datasheet and typical figures for unloaded hobby servos. Replace
+  them with measurements of the real arm. "Power Stats" on the WebSerial page prints the estimates, the time
+  spent in each state and the wake latency. Every change of state is also logged.
+ */
+
+struct PowerEstimates {
+  float cpuActiveMA;     // CPU at full clock, without the radio
+  float cpuIdleMA;       // CPU at powerIdleCpuMHz, without the radio
+  float radioListenMA;   // Wi-Fi receiver listening for ESP-NOW, idle or not
+  float softAPMA;        // extra while the soft AP is up
+  float servoHoldingMA;  // each servo getting pulses, no load
+  float servoRelaxedMA;  // each servo without pulses
+};
+
+const PowerEstimates powerEstimates = { 68, 31, 95, 80, 15, 6 };
+
+unsigned long powerIdleAfterMS = 30000;
+uint32_t powerIdleCpuMHz = 80;  // lowest clock Wi-Fi and BLE run at
+uint32_t powerActiveCpuMHz = 240;
+
+bool powerIdle = false;
+uint16_t relaxedPulseUS[SERVO_JOINT_COUNT];  // pulse width a joint held before it was relaxed, 0 if it was not
+
+unsigned long powerStateSinceMS = 0;
+unsigned long powerIdleMS = 0;
+unsigned long powerActiveMS = 0;
+float powerEstimatedMAh = 0;
+unsigned long powerWakes = 0;
+RadioLatency powerWakeLatency;  // input received until the hand joints were committed again
+
+/**
+ * Estimated current draw of the arm in a given state
+ * @param handRelaxed true when the hand joints get no pulses
+ */
+float powerModelMA(bool idle, bool softAPUp, bool handRelaxed) {
+  float milliamps = (idle ? powerEstimates.cpuIdleMA : powerEstimates.cpuActiveMA) + powerEstimates.radioListenMA;
+  if (softAPUp) milliamps += powerEstimates.softAPMA;
+
+  for (int joint = 0; joint < SERVO_JOINT_COUNT; joint++) {
+    if (servoSchedule.getPin(joint) < 0) continue;
+    milliamps += handRelaxed && handJoints[joint] ? powerEstimates.servoRelaxedMA : powerEstimates.servoHoldingMA;
+  }
+  return milliamps;
+}
+
+/**
+ * Estimated current draw of the arm right now
+ */
+float powerEstimateMA() {
+  float milliamps = powerModelMA(powerIdle, !softAPSuspended, false);
+  for (int joint = 0; joint < SERVO_JOINT_COUNT; joint++) {
+    if (servoSchedule.getPin(joint) >= 0 && servoSchedule.getPulseUS(joint) == 0) {
+      milliamps += powerEstimates.servoRelaxedMA - powerEstimates.servoHoldingMA;
+    }
+  }
+  return milliamps;
+}
+
+/**
+ * Add the time since the last change of state to the totals, call it right before changing state
+ */
+void powerAccount(unsigned long now) {
+  unsigned long elapsedMS = now - powerStateSinceMS;
+  if (powerIdle) powerIdleMS += elapsedMS;
+  else powerActiveMS += elapsedMS;
+  powerEstimatedMAh += powerEstimateMA() * elapsedMS / 3600000.0;
+  powerStateSinceMS = now;
+}
+
+void printPowerState() {
+  Serial.print(powerIdle ? "Power: idle, about " : "Power: active, about ");
+  Serial.print(powerEstimateMA());
+  Serial.println(" mA");
+  WebSerial.print(powerIdle ? "Power: idle, about " : "Power: active, about ");
+  WebSerial.print(powerEstimateMA());
+  WebSerial.println(" mA");
+}
+
+void powerSleep() {
+  powerAccount(millis());
+  powerIdle = true;
+
+  // Only an open hand is let go, a hand that is holding something keeps its grip
+  bool released = fingerPos <= 0 && !handPreshaper.isActive();
+  for (int joint = 0; joint < SERVO_JOINT_COUNT; joint++) {
+    relaxedPulseUS[joint] = 0;
+    if (!released || !handJoints[joint]) continue;
+    relaxedPulseUS[joint] = servoSchedule.getStagedPulseUS(joint);
+    servoSchedule.stage(joint, 0);
+  }
+  commitServoOutputs();
+
+  setCpuFrequencyMhz(powerIdleCpuMHz);
+  profileCpuFrequencyChanged();
+  printPowerState();
+}
+
+void powerWake() {
+  powerAccount(millis());
+  setCpuFrequencyMhz(powerActiveCpuMHz);
+  profileCpuFrequencyChanged();
+
+  for (int joint = 0; joint < SERVO_JOINT_COUNT; joint++) {
+    // Something that wrote the joint since has the newer position
+    if (relaxedPulseUS[joint] && servoSchedule.getStagedPulseUS(joint) == 0) {
+      servoSchedule.stage(joint, relaxedPulseUS[joint]);
+    }
+    relaxedPulseUS[joint] = 0;
+  }
+  commitServoOutputs();
+  powerWakeLatency.record(micros() - lastControlInputUS);
+
+  powerIdle = false;
+  powerWakes++;
+  printPowerState();
+  Serial.print("Wake Latency us: ");
+  Serial.println(powerWakeLatency.lastUS);
+  WebSerial.print("Wake Latency us: ");
+  WebSerial.println(powerWakeLatency.lastUS);
+}
+
+/**
+ * Should be called once the servo outputs have started
+ */
+void powerBegin() {
+  powerActiveCpuMHz = getCpuFrequencyMhz();
+  powerStateSinceMS = millis();
+}
+
+/**
+ * Goes idle or wakes up, call it every pass of the main loop and every control tick before processToeButtons()
+ */
+void powerLoop() {
+  // A held toe keeps driving the hand even though the payload does not change
+  if (bigToeValue == 1 || smallToeValue == 1) radioControlInput();
+
+  // Read the input time before the clock, the ESP-NOW callback can move it forward in between
+  unsigned long lastInputMS = lastControlInputMS;
+  bool idle = millis() - lastInputMS >= powerIdleAfterMS;
+  if (idle == powerIdle) return;
+
+  if (idle) powerSleep();
+  else powerWake();
+}
+
+void printPowerStats() {
+  powerAccount(millis());
+  printPowerState();
+  WebSerial.print("Estimate mA (idle with the hand released / active): ");
+  WebSerial.print(powerModelMA(true, false, true));
+  WebSerial.print(" / ");
+  WebSerial.println(powerModelMA(false, false, false));
+  WebSerial.print("Idle / Active s: ");
+  WebSerial.print(powerIdleMS / 1000);
+  WebSerial.print(" / ");
+  WebSerial.println(powerActiveMS / 1000);
+  WebSerial.print("Estimated mAh Used: ");
+  WebSerial.println(powerEstimatedMAh);
+  WebSerial.print("Wakes: ");
+  WebSerial.println(powerWakes);
+  printRadioLatency("Wake", powerWakeLatency);
+}
@@ -2,14 +2,16 @@
   2023-24 Foot Button Code 
   Written by: Gerbert Funes
 
-  Depends on
-  https://github.com/poelstra/arduino-multi-button  
+  Mode changes are recognized by the table driven gesture state machine in toeGestures.h
+  and the hand is pre-shaped for the new mode by handPreshape.h
+  In pressure mode the grip speed comes from toePressure.h
+  The gesture table, the grip steps, the pre-shaping poses and the joint calibration are in handConfig.h
  */
 
-#include <MultiButton.h>
-
-MultiButton bigToe;
-MultiButton smallToe;
+#include "toeGestures.h"
+#include "handConfig.h"
+#include "handPreshape.h"
+#include "toePressure.h"
 
 // Toes States
 bool lastBigToeState = false;
@@ -21,120 +23,174 @@ int bigToeValue = 0;
 int smallToeValue = 0;
 int buttonValueCounter = 0;
 
-// Used to handle clicking one button after another to trigger event.
-bool bigToeClicked = false;
-bool smallToeClicked = false;
-unsigned long lastBigToeClick;
-unsigned long lastSmallToeClick;
-int nextClickMSThreshold = 2000;
+ToeGestureRecognizer toeGestures(toeGestureTable, toeGestureCount);
+ToeEdgeQueue toeEdgeQueue;
+portMUX_TYPE toeEdgeLock = portMUX_INITIALIZER_UNLOCKED;
 
-// Finger Servo Motor calibration
-float fingerPos = 160;
-float ringPinkPos = 0;
-int minFingerMotorPos = 0;
-int maxFingerMotorPos = 160;
-int minThumbMotorPos = 80;
+/**
+ * Queue a toe edge for the gesture recognizer. Safe to call from the ESP-NOW callback.
+ */
+void queueToeEdge(uint8_t toe, bool pressed) {
+  portENTER_CRITICAL(&toeEdgeLock);
+  toeEdgeQueue.push(toe, pressed, millis());
+  portEXIT_CRITICAL(&toeEdgeLock);
+}
+
+/**
+ * Hand the queued toe edges to the gesture recognizer, oldest first
+ */
+void drainToeEdges() {
+  ToeEdge edge;
+  while (true) {
+    portENTER_CRITICAL(&toeEdgeLock);
+    bool queued = toeEdgeQueue.pop(edge);
+    portEXIT_CRITICAL(&toeEdgeLock);
+    if (!queued) return;
+    toeGestures.edge(edge.toe, edge.pressed, edge.at);
+  }
+}
+
+// Toe pressures from a foot unit in pressure mode. Samples come in on the ESP-NOW callback too, so every use
+// of the mapper takes toePressureLock.
+ToePressureMapper toePressureMapper;
+portMUX_TYPE toePressureLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Finger positions, 0 = open, 1 = closed. How far each joint really moves is set by its calibration table.
+float fingerPos = 0;
+float gripSpeed = 1;  // multiplies every grip and release step, set from the toe pressure
 
 //Thumb Movement 
-int thumbBaseMovement = 0;
-int thumbBaseDefault = 30;
-int thumbMovement = 0;
-int thumbBaseGripMax = 0;
-int thumbBasePinchMax = 40;
-int thumbBaseTripodMax = 60;
-int thumbBasePointMax = 90;
+float thumbBaseMovement = 0;
+float thumbMovement = 0;
 
 // Finger Pins
   // Thumb
   int thumbPin = 32;
   //int thumbPin = 15;
-  Servo thumbServo;
+  JointServo thumbServo(JOINT_THUMB, &thumbTable);
 
   // Thumb
   int thumbBasePin = 5;
-  Servo thumbBaseServo;
+  JointServo thumbBaseServo(JOINT_THUMB_BASE, &thumbBaseTable);
 
   // Index
   int indexPin = 25;
-  Servo indexServo;
+  JointServo indexServo(JOINT_INDEX, &indexTable);
 
   // Middle
   int middlePin = 26;
-  Servo middleServo;
+  JointServo middleServo(JOINT_MIDDLE, &middleTable);
 
   // Ring
   int ringPin = 23;
-  Servo ringServo;
+  JointServo ringServo(JOINT_RING, &ringTable);
 
   // Pinky
   int pinkPin = 27;
-  Servo pinkServo;
+  JointServo pinkServo(JOINT_PINK, &pinkTable);
 
 // Maximum number of finger poses
 int fingerType = 0;
 int maxFingerTypes = 3;
 
+// The wrist is never pre-shaped
+JointServo *handJoints[SERVO_JOINT_COUNT] = { &thumbServo, &thumbBaseServo, &indexServo, &middleServo, &ringServo, &pinkServo, nullptr, nullptr };
+HandPreshaper handPreshaper(handJoints, handRestPosition, preshapePoses, sizeof(preshapePoses) / sizeof(preshapePoses[0]));
+
+/**
+ * Glide towards the ready posture of the current mode until a grip or release takes over
+ */
+void preshapeHand() {
+  if (!handPreshaper.isActive()) return;
+
+  if (bigToeValue == 1 || smallToeValue == 1) {
+    handPreshaper.cancel();
+    // The grips move the thumb base one step per pass starting at thumbBaseDefault
+    if (bigToeValue == 1 && fingerType != 0 && thumbBaseMovement > thumbBaseDefault) {
+      Serial.print("Pre-Shaping saved ");
+      Serial.print((int)((thumbBaseMovement - thumbBaseDefault) / thumbBaseStep));
+      Serial.println(" thumb base steps");
+      WebSerial.print("Pre-Shaping saved ");
+      WebSerial.print((int)((thumbBaseMovement - thumbBaseDefault) / thumbBaseStep));
+      WebSerial.println(" thumb base steps");
+    }
+    return;
+  }
+
+  bool thumbBaseDriven = handPreshaper.drives(JOINT_THUMB_BASE);
+  handPreshaper.update(millis());
+  if (thumbBaseDriven) thumbBaseMovement = handPreshaper.getPosition(JOINT_THUMB_BASE);
+}
+
+/**
+ * Apply a recognized toe gesture to the finger mode, wrist lock or maintenance soft AP
+ */
+void applyToeGesture(ToeGestureEvent gesture) {
+  flightRecord(RECORD_GESTURE, SOURCE_ARM, gesture.action, gesture.latencyMS);
+
+  if (gesture.action == ACTION_NEXT_MODE) fingerType = fingerType + 1;
+  if (gesture.action == ACTION_PREVIOUS_MODE) fingerType = fingerType - 1;
+  if (gesture.action == ACTION_SET_MODE) fingerType = gesture.value;
+  if (gesture.action == ACTION_WRIST_LOCK) wristLocked = !wristLocked;
+  if (gesture.action == ACTION_MAINTENANCE) setSoftAPEnabled(!softAPEnabled);
+
+  if (fingerType > maxFingerTypes) fingerType = 0;
+  if (fingerType < 0) fingerType = maxFingerTypes;
+  flightRecord(RECORD_MODE, SOURCE_ARM, fingerType, wristLocked);
+
+  Serial.print(gesture.name);
+  Serial.print(" (decided in ");
+  Serial.print(gesture.latencyMS);
+  Serial.println(" ms)");
+  WebSerial.print(gesture.name);
+  WebSerial.print(" (decided in ");
+  WebSerial.print(gesture.latencyMS);
+  WebSerial.println(" ms)");
+
+  if (gesture.action == ACTION_WRIST_LOCK) {
+    Serial.println(wristLocked ? "Wrist Locked" : "Wrist Unlocked");
+    WebSerial.println(wristLocked ? "Wrist Locked" : "Wrist Unlocked");
+    return;
+  }
+
+  if (gesture.action == ACTION_MAINTENANCE) {
+    Serial.println(softAPEnabled ? "Maintenance AP On" : "Maintenance AP Off");
+    WebSerial.println(softAPEnabled ? "Maintenance AP On" : "Maintenance AP Off");
+    return;
+  }
+
+  Serial.print("Finger Mode = ");
+  WebSerial.print("Finger Mode = ");
+  WebSerial.println(fingerType);
+  Serial.println(fingerType);
+
+  handPreshaper.start(fingerType, millis());
+}
+
 void processToeButtons() {
+  PROFILE_SCOPE("processToeButtons");
+
   /**
  Changing Modes:
   - You can change mode by either pressing the big toe first and then the small toes or you could press the small toes first and then the big toe. This combination can be in any order, the mode will still change to the one thats next in the order no matter which one you chose to do
+  - Holding both toes and then pressing both goes back to the full grip and pressing both toes together locks or unlocks the wrist. Tapping one toe twice only grips or releases a little more. Look at @param toeGestureTable to change these.
 */
-  bigToe.update(lastBigToeState);
-  smallToe.update(lastSmallToeState);
+  drainToeEdges();
+  toeGestures.update(millis());
 
-  if (bigToe.isSingleClick()) {
-    lastBigToeClick = millis();
-    bigToeClicked = true;
-  }
-  if (smallToe.isSingleClick()) {
-    lastSmallToeClick = millis();
-    smallToeClicked = true;
+  ToeGestureEvent gesture;
+  while (toeGestures.poll(gesture)) {
+    applyToeGesture(gesture);
   }
 
-  if (bigToeClicked) {
-    if ((millis() - lastBigToeClick) < nextClickMSThreshold) {
-      if (smallToe.isSingleClick()) {
-        fingerType = fingerType + 1;
-        Serial.print("Finger Mode = ");
-        WebSerial.print("Finger Mode = ");
-        WebSerial.println(fingerType);
-        Serial.println(fingerType);
-        
-        if (fingerType > maxFingerTypes) {
-          fingerType = 0;
-          Serial.print("Finger Mode = ");
-          WebSerial.print("Finger Mode = ");
-          WebSerial.println(fingerType);
-          Serial.println(fingerType);
-        }
-        bigToeClicked = false;
-        smallToeClicked = false;
-        return;
-      }
-    }
-  }
+  preshapeHand();
 
-  if (smallToeClicked) {
-    if ((millis() - lastSmallToeClick) < nextClickMSThreshold) {
-      if (bigToe.isSingleClick()) {
-        fingerType = fingerType + 1;
-        Serial.print("Finger Mode = ");
-        WebSerial.print("Finger Mode = ");
-        WebSerial.println(fingerType);
-        Serial.println(fingerType);
-        if (fingerType > maxFingerTypes) {
-          fingerType = 0;
-          Serial.print("Finger Mode = ");
-          WebSerial.print("Finger Mode = ");
-          WebSerial.println(fingerType);
-          Serial.println(fingerType);
-        }
-        bigToeClicked = false;
-        smallToeClicked = false;
-        return;
-      }
-    }
-  }
+  // In pressure mode the pressure of the toe sets how fast the grips and releases move, buttons always move at the same speed
+  gripSpeed = 1;
+  portENTER_CRITICAL(&toePressureLock);
+  if (bigToeValue == 1) gripSpeed = toePressureMapper.speed(BIG_TOE, fingerPos);
+  else if (smallToeValue == 1) gripSpeed = toePressureMapper.speed(SMALL_TOE, 1 - fingerPos);
+  portEXIT_CRITICAL(&toePressureLock);
 
   /**
  Gripping:
@@ -144,8 +200,11 @@ void processToeButtons() {
 */
   // Full Grip
   if (bigToeValue == 1 && fingerType == 0) {
-    Serial.println("Grip");
-    WebSerial.println("Grip");
+    {
+      PROFILE_SCOPE("print");
+      Serial.println("Grip");
+      WebSerial.println("Grip");
+    }
 
     if (thumbBaseMovement <= thumbBaseGripMax){
 
@@ -154,31 +213,32 @@ void processToeButtons() {
     }
 
     // Finger Movement
-    indexServo.write(fingerPos);
-    middleServo.write(fingerPos);
-    pinkServo.write(ringPinkPos);
-    ringServo.write(ringPinkPos);
-    fingerPos = fingerPos - 5;
-    ringPinkPos = ringPinkPos + 5;
+    indexServo.writePosition(fingerPos);
+    middleServo.writePosition(fingerPos);
+    pinkServo.writePosition(fingerPos);
+    ringServo.writePosition(fingerPos);
+    fingerPos = fingerPos + fingerStep * gripSpeed;
 
     // Thumb Movement
-    thumbServo.write(thumbMovement);
-    //thumbBaseServo.write(thumbBaseMovement);
-    thumbBaseMovement = thumbBaseMovement - 1;
-    thumbMovement = thumbMovement - 2;
-    if (fingerPos < minFingerMotorPos) {
+    thumbServo.writePosition(thumbMovement);
+    //thumbBaseServo.writePosition(thumbBaseMovement);
+    thumbBaseMovement = thumbBaseMovement - thumbBaseStep * gripSpeed;
+    thumbMovement = thumbMovement + thumbStep * gripSpeed;
+    if (fingerPos > 1) {
 
       //Locks the number of movements to max value in order to not cause overflow error
-      fingerPos = minFingerMotorPos;
-      ringPinkPos = maxFingerMotorPos;
-      thumbMovement = minThumbMotorPos;
+      fingerPos = 1;
+      thumbMovement = 1;
     }
   }
 
   // Pinch
   if (bigToeValue == 1 && fingerType == 1) {
-    Serial.println("Grip_Pinch");
-    WebSerial.println("Grip_Pinch");
+    {
+      PROFILE_SCOPE("print");
+      Serial.println("Grip_Pinch");
+      WebSerial.println("Grip_Pinch");
+    }
 
     if (thumbBaseMovement >= thumbBasePinchMax){
 
@@ -192,34 +252,38 @@ void processToeButtons() {
       thumbBaseMovement = thumbBaseDefault;
     }
 
-    indexServo.write(fingerPos);
-    //middleServo.write(fingerPos);
-    //ringPinkServo.write(fingerPos);
+    indexServo.writePosition(fingerPos);
+    //middleServo.writePosition(fingerPos);
+    //ringPinkServo.writePosition(fingerPos);
     
     // Thumb Movement
-    thumbServo.write(thumbMovement);
-    thumbBaseServo.write(thumbBaseMovement);
+    thumbServo.writePosition(thumbMovement);
+    thumbBaseServo.writePosition(thumbBaseMovement);
     
     // Counters
-    fingerPos = fingerPos - 5;
-    ringPinkPos = ringPinkPos + 5;
-    thumbBaseMovement = thumbBaseMovement + 1;
-    thumbMovement = thumbMovement - 2;
-    Serial.println(thumbBaseMovement);
+    fingerPos = fingerPos + fingerStep * gripSpeed;
+    thumbBaseMovement = thumbBaseMovement + thumbBaseStep * gripSpeed;
+    thumbMovement = thumbMovement + thumbStep * gripSpeed;
+    {
+      PROFILE_SCOPE("print");
+      Serial.println(thumbBaseMovement);
+    }
 
-    if (fingerPos < minFingerMotorPos) {
+    if (fingerPos > 1) {
 
       //Locks the number of movements to max value in order to not cause overflow error
-      fingerPos = minFingerMotorPos;
-      ringPinkPos = maxFingerMotorPos;
-      thumbMovement = minThumbMotorPos;
+      fingerPos = 1;
+      thumbMovement = 1;
     }
   }
 
   // Tripod
   if (bigToeValue == 1 && fingerType == 2) {
-    Serial.println("Grip_Tripod");
-    WebSerial.println("Grip_Tripod");
+    {
+      PROFILE_SCOPE("print");
+      Serial.println("Grip_Tripod");
+      WebSerial.println("Grip_Tripod");
+    }
 
     if (thumbBaseMovement >= thumbBaseTripodMax){
 
@@ -233,34 +297,38 @@ void processToeButtons() {
       thumbBaseMovement = thumbBaseDefault;
     }
 
-    indexServo.write(fingerPos);
-    middleServo.write(fingerPos);
-    //ringPinkServo.write(fingerPos);
+    indexServo.writePosition(fingerPos);
+    middleServo.writePosition(fingerPos);
+    //ringPinkServo.writePosition(fingerPos);
 
     // Thumb Movement
-    thumbServo.write(thumbMovement);
-    thumbBaseServo.write(thumbBaseMovement);
+    thumbServo.writePosition(thumbMovement);
+    thumbBaseServo.writePosition(thumbBaseMovement);
     
     // Counters
-    fingerPos = fingerPos - 5;
-    ringPinkPos = ringPinkPos + 5;
-    thumbBaseMovement = thumbBaseMovement + 1;
-    thumbMovement = thumbMovement - 2;
-    Serial.println(thumbBaseMovement);
+    fingerPos = fingerPos + fingerStep * gripSpeed;
+    thumbBaseMovement = thumbBaseMovement + thumbBaseStep * gripSpeed;
+    thumbMovement = thumbMovement + thumbStep * gripSpeed;
+    {
+      PROFILE_SCOPE("print");
+      Serial.println(thumbBaseMovement);
+    }
 
-    if (fingerPos < minFingerMotorPos) {
+    if (fingerPos > 1) {
 
       //Locks the number of movements to max value in order to not cause overflow error
-      fingerPos = minFingerMotorPos;
-      ringPinkPos = maxFingerMotorPos;
-      thumbMovement = minThumbMotorPos;
+      fingerPos = 1;
+      thumbMovement = 1;
     }
   }
 
   // Point
   if (bigToeValue == 1 && fingerType == 3) {
-    Serial.println("Grip_Point");
-    WebSerial.println("Grip_Point");
+    {
+      PROFILE_SCOPE("print");
+      Serial.println("Grip_Point");
+      WebSerial.println("Grip_Point");
+    }
 
     if (thumbBaseMovement >= thumbBasePointMax){
 
@@ -274,28 +342,29 @@ void processToeButtons() {
       thumbBaseMovement = thumbBaseDefault;
     }
 
-    //indexServo.write(fingerPos);
-    middleServo.write(fingerPos);
-    pinkServo.write(ringPinkPos);
-    ringServo.write(ringPinkPos);
+    //indexServo.writePosition(fingerPos);
+    middleServo.writePosition(fingerPos);
+    pinkServo.writePosition(fingerPos);
+    ringServo.writePosition(fingerPos);
 
         // Thumb Movement
-    thumbServo.write(thumbMovement);
-    thumbBaseServo.write(thumbBaseMovement);
+    thumbServo.writePosition(thumbMovement);
+    thumbBaseServo.writePosition(thumbBaseMovement);
     
     // Counters
-    fingerPos = fingerPos - 5;
-    ringPinkPos = ringPinkPos + 5;
-    thumbBaseMovement = thumbBaseMovement + 1;
-    thumbMovement = thumbMovement - 2;
-    Serial.println(thumbBaseMovement);
+    fingerPos = fingerPos + fingerStep * gripSpeed;
+    thumbBaseMovement = thumbBaseMovement + thumbBaseStep * gripSpeed;
+    thumbMovement = thumbMovement + thumbStep * gripSpeed;
+    {
+      PROFILE_SCOPE("print");
+      Serial.println(thumbBaseMovement);
+    }
 
-    if (fingerPos < minFingerMotorPos) {
+    if (fingerPos > 1) {
 
       //Locks the number of movements to max value in order to not cause overflow error
-      fingerPos = minFingerMotorPos;
-      ringPinkPos = maxFingerMotorPos;
-      thumbMovement = minThumbMotorPos;
+      fingerPos = 1;
+      thumbMovement = 1;
     }
   }
 
@@ -308,116 +377,120 @@ void processToeButtons() {
 
   // Release Full Grip
   if (smallToeValue == 1 && fingerType == 0) {
-    Serial.println("unGrip");
-    WebSerial.println("unGrip");
+    {
+      PROFILE_SCOPE("print");
+      Serial.println("unGrip");
+      WebSerial.println("unGrip");
+    }
     
     // Finger Movement
-    indexServo.write(fingerPos);
-    middleServo.write(fingerPos);
-    pinkServo.write(ringPinkPos);
-    ringServo.write(ringPinkPos);
-    fingerPos = fingerPos + 5;
-    ringPinkPos = ringPinkPos - 5;
+    indexServo.writePosition(fingerPos);
+    middleServo.writePosition(fingerPos);
+    pinkServo.writePosition(fingerPos);
+    ringServo.writePosition(fingerPos);
+    fingerPos = fingerPos - fingerStep * gripSpeed;
 
     // Thumb Movement
-    thumbServo.write(thumbMovement);
-    thumbBaseServo.write(thumbBaseMovement);
-    thumbBaseMovement = thumbBaseMovement - 1;
-    thumbMovement = thumbMovement + 2;
+    thumbServo.writePosition(thumbMovement);
+    thumbBaseServo.writePosition(thumbBaseMovement);
+    thumbBaseMovement = thumbBaseMovement - thumbBaseStep * gripSpeed;
+    thumbMovement = thumbMovement - thumbStep * gripSpeed;
 
-    if (fingerPos > maxFingerMotorPos) {
+    if (fingerPos < 0) {
 
       //Locks the number of movements to max value in order to not cause overflow error
-      fingerPos = maxFingerMotorPos;
-      ringPinkPos = minFingerMotorPos;
-      thumbMovement = maxFingerMotorPos;
+      fingerPos = 0;
+      thumbMovement = 0;
     }
   }
 
   // Release Pinch
   if (smallToeValue == 1 && fingerType == 1) {
-    Serial.println("unGrip_Pinch");
-    WebSerial.println("unGrip_Pinch");
+    {
+      PROFILE_SCOPE("print");
+      Serial.println("unGrip_Pinch");
+      WebSerial.println("unGrip_Pinch");
+    }
 
-    indexServo.write(fingerPos);
-    //middleServo.write(fingerPos);
-    //ringPinkServo.write(fingerPos);
+    indexServo.writePosition(fingerPos);
+    //middleServo.writePosition(fingerPos);
+    //ringPinkServo.writePosition(fingerPos);
 
     // Thumb Movement
-    thumbServo.write(thumbMovement);
-    thumbBaseServo.write(thumbBaseMovement);
+    thumbServo.writePosition(thumbMovement);
+    thumbBaseServo.writePosition(thumbBaseMovement);
 
     //Counters
-    fingerPos = fingerPos + 5;
-    ringPinkPos = ringPinkPos - 5;
-    thumbBaseMovement = thumbBaseMovement - 1;
-    thumbMovement = thumbMovement + 2;
+    fingerPos = fingerPos - fingerStep * gripSpeed;
+    thumbBaseMovement = thumbBaseMovement - thumbBaseStep * gripSpeed;
+    thumbMovement = thumbMovement - thumbStep * gripSpeed;
     
 
-    if (fingerPos > maxFingerMotorPos) {
+    if (fingerPos < 0) {
 
       //Locks the number of movements to max value in order to not cause overflow error
-      fingerPos = maxFingerMotorPos;
-      ringPinkPos = minFingerMotorPos;
-      thumbMovement = maxFingerMotorPos;
+      fingerPos = 0;
+      thumbMovement = 0;
     }
   }
 
   // Release Tripod
   if (smallToeValue == 1 && fingerType == 2) {
-    Serial.println("unGrip_Tripod");
-    WebSerial.println("unGrip_Tripod");
+    {
+      PROFILE_SCOPE("print");
+      Serial.println("unGrip_Tripod");
+      WebSerial.println("unGrip_Tripod");
+    }
 
-    indexServo.write(fingerPos);
-    thumbServo.write(fingerPos);
-    middleServo.write(fingerPos);
-    //ringPinkServo.write(fingerPos);
+    indexServo.writePosition(fingerPos);
+    thumbServo.writePosition(fingerPos);
+    middleServo.writePosition(fingerPos);
+    //ringPinkServo.writePosition(fingerPos);
 
     // Thumb Movement
-    thumbServo.write(thumbMovement);
-    thumbBaseServo.write(thumbBaseMovement);
+    thumbServo.writePosition(thumbMovement);
+    thumbBaseServo.writePosition(thumbBaseMovement);
 
     //Counters
-    fingerPos = fingerPos + 5;
-    ringPinkPos = ringPinkPos - 5;
-    thumbBaseMovement = thumbBaseMovement - 1;
-    thumbMovement = thumbMovement + 2;
+    fingerPos = fingerPos - fingerStep * gripSpeed;
+    thumbBaseMovement = thumbBaseMovement - thumbBaseStep * gripSpeed;
+    thumbMovement = thumbMovement - thumbStep * gripSpeed;
 
-    if (fingerPos > maxFingerMotorPos) {
+    if (fingerPos < 0) {
 
       //Locks the number of movements to max value in order to not cause overflow error
-      fingerPos = maxFingerMotorPos;
-      ringPinkPos = minFingerMotorPos;
-      thumbMovement = maxFingerMotorPos;
+      fingerPos = 0;
+      thumbMovement = 0;
     }
   }
 
   // Release Point
   if (smallToeValue == 1 && fingerType == 3) {
-    Serial.println("unGrip_Point");
-    WebSerial.println("unGrip_Point");
+    {
+      PROFILE_SCOPE("print");
+      Serial.println("unGrip_Point");
+      WebSerial.println("unGrip_Point");
+    }
 
-    //indexServo.write(fingerPos);
-    middleServo.write(fingerPos);
-    pinkServo.write(ringPinkPos);
-    ringServo.write(ringPinkPos);
+    //indexServo.writePosition(fingerPos);
+    middleServo.writePosition(fingerPos);
+    pinkServo.writePosition(fingerPos);
+    ringServo.writePosition(fingerPos);
 
     // Thumb Movement
-    thumbServo.write(thumbMovement);
-    thumbBaseServo.write(thumbBaseMovement);
+    thumbServo.writePosition(thumbMovement);
+    thumbBaseServo.writePosition(thumbBaseMovement);
 
     //Counters
-    fingerPos = fingerPos + 5;
-    ringPinkPos = ringPinkPos - 5;
-    thumbBaseMovement = thumbBaseMovement - 1;
-    thumbMovement = thumbMovement + 2;
+    fingerPos = fingerPos - fingerStep * gripSpeed;
+    thumbBaseMovement = thumbBaseMovement - thumbBaseStep * gripSpeed;
+    thumbMovement = thumbMovement - thumbStep * gripSpeed;
 
-    if (fingerPos > maxFingerMotorPos) {
+    if (fingerPos < 0) {
 
       //Locks the number of movements to max value in order to not cause overflow error
-      fingerPos = maxFingerMotorPos;
-      ringPinkPos = minFingerMotorPos;
-      thumbMovement = maxFingerMotorPos;
+      fingerPos = 0;
+      thumbMovement = 0;
     }
   }
 }
\ No newline at end of file
@@ -0,0 +1,164 @@
+/**
+  2023-24 Arm Profiler
+
+  Scoped timing probes based on the CPU cycle counter, served with heap, stack and loop rate numbers on
+  http://4.8.6.1/metrics in the Prometheus text format.
+
+  Adding a probe:
+    void moveWristRotation(short direction) {
+      PROFILE_SCOPE("moveWristRotation");
+      ...
+    }
+  Every call adds the time spent until the end of the enclosing block. Probes with the same name are added
+  together, which is how all the Serial/WebSerial prints end up in the one "print" probe.
+
+  The cycle counter runs at the CPU clock, which powerManager.h lowers while the arm is idle. Every call is
+  turned into microseconds with the clock it ran at, so call profileCpuFrequencyChanged() after
+  setCpuFrequencyMhz().
+
+  Probes only exist when ARM_PROFILING is defined before this file is included, it is off by default. Without it
+  PROFILE_SCOPE expands to nothing, and /metrics only reports heap, stacks and loop rate.
+
+  The quantiles come from the latest PROFILER_SAMPLES calls of a probe. That window is too short for a 0.99
+  quantile, so the slowest call in it is reported as arm_probe_microseconds_recent_max instead.
+ */
+
+#include <algorithm>
+#include <float.h>
+
+#define PROFILER_MAX_PROBES 16
+#define PROFILER_SAMPLES 64
+
+struct ProfileProbe {
+  const char *name;
+  uint32_t calls;
+  double totalUS;
+  float minUS;
+  float maxUS;
+  float samples[PROFILER_SAMPLES];  // latest durations in us, used for the quantiles and the recent max
+};
+
+float profileCyclesPerUS = 0;  // CPU clock in MHz, 0 until first read
+
+/**
+ * Read the CPU clock again, the cycle counts after this are converted with it
+ */
+void profileCpuFrequencyChanged() {
+  profileCyclesPerUS = getCpuFrequencyMhz();
+}
+
+#ifdef ARM_PROFILING
+
+ProfileProbe profileProbes[PROFILER_MAX_PROBES];
+int profileProbeCount = 0;
+
+/**
+ * Find a probe by name, adding it the first time
+ * @returns nullptr once PROFILER_MAX_PROBES are in use
+ */
+ProfileProbe *profileProbe(const char *name) {
+  for (int i = 0; i < profileProbeCount; i++) {
+    if (strcmp(profileProbes[i].name, name) == 0) return &profileProbes[i];
+  }
+  if (profileProbeCount == PROFILER_MAX_PROBES) return nullptr;
+
+  ProfileProbe &probe = profileProbes[profileProbeCount++];
+  probe.name = name;
+  probe.minUS = FLT_MAX;
+  return &probe;
+}
+
+class ProfileScope {
+  private:
+    ProfileProbe *probe;
+    uint32_t startCycles;
+
+  public:
+    ProfileScope(ProfileProbe *probe) : probe(probe), startCycles(ESP.getCycleCount()) {}
+
+    ~ProfileScope() {
+      if (!probe) return;
+      uint32_t cycles = ESP.getCycleCount() - startCycles;
+      if (profileCyclesPerUS == 0) profileCpuFrequencyChanged();
+      float us = cycles / profileCyclesPerUS;
+      probe->samples[probe->calls % PROFILER_SAMPLES] = us;
+      probe->calls++;
+      probe->totalUS += us;
+      if (us < probe->minUS) probe->minUS = us;
+      if (us > probe->maxUS) probe->maxUS = us;
+    }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) \
+  static ProfileProbe *PROFILE_CONCAT(profileProbe_, __LINE__) = profileProbe(name); \
+  ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(PROFILE_CONCAT(profileProbe_, __LINE__))
+
+#else
+
+#define PROFILE_SCOPE(name)
+
+#endif
+
+// Loop rate and stacks are reported with or without probes
+TaskHandle_t profileLoopTask = nullptr;
+unsigned long loopPasses = 0;
+unsigned long loopRateWindowStart = 0;
+float loopRateHz = 0;
+
+/**
+ * Count one pass of the control loop, the rate is worked out every second
+ */
+void profileLoopPass() {
+  loopPasses++;
+  unsigned long elapsed = millis() - loopRateWindowStart;
+  if (elapsed < 1000) return;
+  loopRateHz = loopPasses * 1000.0 / elapsed;
+  loopPasses = 0;
+  loopRateWindowStart = millis();
+}
+
+/**
+ * GET /metrics
+ */
+void profileMetrics(AsyncWebServerRequest *request) {
+  AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+
+  response->printf("# TYPE arm_heap_free_bytes gauge\narm_heap_free_bytes %u\n", ESP.getFreeHeap());
+  response->printf("# TYPE arm_heap_min_free_bytes gauge\narm_heap_min_free_bytes %u\n", ESP.getMinFreeHeap());
+  response->printf("# TYPE arm_stack_high_water_bytes gauge\n");
+  if (profileLoopTask) response->printf("arm_stack_high_water_bytes{task=\"loopTask\"} %u\n", uxTaskGetStackHighWaterMark(profileLoopTask));
+  response->printf("arm_stack_high_water_bytes{task=\"async_tcp\"} %u\n", uxTaskGetStackHighWaterMark(NULL));
+  response->printf("# TYPE arm_loop_rate_hz gauge\narm_loop_rate_hz %.1f\n", loopRateHz);
+
+#ifdef ARM_PROFILING
+  response->printf("# TYPE arm_probe_calls_total counter\n");
+  for (int i = 0; i < profileProbeCount; i++) {
+    response->printf("arm_probe_calls_total{probe=\"%s\"} %u\n", profileProbes[i].name, profileProbes[i].calls);
+  }
+
+  response->printf("# TYPE arm_probe_microseconds summary\n");
+  for (int i = 0; i < profileProbeCount; i++) {
+    ProfileProbe &probe = profileProbes[i];
+    if (probe.calls == 0) continue;
+
+    // Sort a copy of the latest samples for the quantiles, the loop keeps writing the probe meanwhile
+    int count = min(probe.calls, (uint32_t)PROFILER_SAMPLES);
+    float sorted[PROFILER_SAMPLES];
+    memcpy(sorted, probe.samples, sizeof(sorted));
+    std::sort(sorted, sorted + count);
+
+    response->printf("arm_probe_microseconds{probe=\"%s\",quantile=\"0.5\"} %.2f\n", probe.name, sorted[count / 2]);
+    response->printf("arm_probe_microseconds{probe=\"%s\",quantile=\"0.9\"} %.2f\n", probe.name, sorted[count * 9 / 10]);
+    response->printf("arm_probe_microseconds_sum{probe=\"%s\"} %.0f\n", probe.name, probe.totalUS);
+    response->printf("arm_probe_microseconds_count{probe=\"%s\"} %u\n", probe.name, probe.calls);
+    response->printf("arm_probe_microseconds_min{probe=\"%s\"} %.2f\n", probe.name, probe.minUS);
+    response->printf("arm_probe_microseconds_avg{probe=\"%s\"} %.2f\n", probe.name, probe.totalUS / probe.calls);
+    response->printf("arm_probe_microseconds_max{probe=\"%s\"} %.2f\n", probe.name, probe.maxUS);
+    response->printf("arm_probe_microseconds_recent_max{probe=\"%s\"} %.2f\n", probe.name, sorted[count - 1]);
+  }
+#endif
+
+  request->send(response);
+}
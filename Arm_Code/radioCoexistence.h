@@ -0,0 +1,222 @@
+/**
+  2023-24 Radio Coexistence
+
+  The arm's one ESP32 radio is shared by the soft AP (dashboard, WebSerial, OTA), ESP-NOW from the Foot Sleeve
+  and BLE to the Foot Controller. This keeps the control traffic ahead of the dashboard traffic:
+    - The soft AP and ESP-NOW are pinned to RADIO_CHANNEL. The Foot Sleeve starts sending on the same channel
+      (ARM_RADIO_CHANNEL in FootSleeve_4_9_ESPNOW.ino) and looks for the arm on the other channels if it
+      stops getting acknowledgements.
+    - The soft AP is off until it is turned on for maintenance, by holding both toes twice (see
+      toeGestureTable) or with "Maintenance On" on the WebSerial page, which also restarts its timer. It turns
+      itself off again after softAPTimeoutMS once no station is connected and no OTA is being received.
+      "Maintenance Off" turns it off right away.
+    - The hand counts as active for radioActiveHoldMS after the last foot input. What happens to the soft AP
+      while it is active depends on the policy:
+        RADIO_POLICY_BALANCED    Wi-Fi and BLE get equal airtime, the AP is left alone
+        RADIO_POLICY_THROTTLE_AP BLE gets the airtime while the hand is active, which throttles the AP
+        RADIO_POLICY_SUSPEND_AP  as above, and the AP is turned off until the hand has been idle. It is kept
+                                 up while a compressed OTA is being received.
+    - The latency of each radio is measured so the policies can be compared. "Radio Stats" on the WebSerial
+      page prints it, "Radio Balanced", "Radio Throttle" and "Radio Suspend" switch the policy and reset it.
+      ESP-NOW packets are stamped in OnDataRecv(), the control tick that acts on them takes the stamp with
+      radioControlTick() and records the latency once it has committed the servos.
+
+  Depends on
+  https://docs.espressif.com/projects/esp-idf/en/v4.4/esp32/api-guides/coexist.html
+  https://docs.espressif.com/projects/esp-idf/en/v4.4/esp32/api-reference/network/esp_now.html
+ */
+
+#include <esp_wifi.h>
+#include <esp_coexist.h>
+
+#define RADIO_CHANNEL 6
+
+enum RadioPolicy : uint8_t {
+  RADIO_POLICY_BALANCED = 0,
+  RADIO_POLICY_THROTTLE_AP,
+  RADIO_POLICY_SUSPEND_AP
+};
+
+const char *radioPolicyNames[] = { "balanced", "throttle AP", "suspend AP" };
+
+struct RadioLatency {
+  unsigned long samples;
+  unsigned long lastUS;
+  unsigned long maxUS;
+  unsigned long long totalUS;
+
+  void record(unsigned long us) {
+    samples++;
+    lastUS = us;
+    totalUS += us;
+    if (us > maxUS) maxUS = us;
+  }
+};
+
+RadioPolicy radioPolicy = RADIO_POLICY_THROTTLE_AP;
+unsigned long radioActiveHoldMS = 3000;
+
+volatile unsigned long lastControlInputMS = 0;
+volatile unsigned long lastControlInputUS = 0;
+bool radioHandActive = false;
+bool softAPEnabled = false;  // maintenance switch, set it to true to have the soft AP up from boot
+unsigned long softAPEnabledMS = 0;
+unsigned long softAPTimeoutMS = 600000;
+bool softAPSuspended = false;
+unsigned long softAPSuspensions = 0;
+
+RadioLatency bleReadLatency;     // GATT read round trip to the Foot Controller
+RadioLatency espNowLatency;      // ESP-NOW receive from the Foot Sleeve until the servo commit that follows it
+volatile unsigned long espNowReceivedUS = 0;  // oldest packet no control tick has acted on yet
+volatile bool espNowPending = false;
+portMUX_TYPE espNowLock = portMUX_INITIALIZER_UNLOCKED;
+unsigned long espNowTickReceivedUS = 0;  // packet the running control tick acts on
+bool espNowInTick = false;
+
+/**
+ * Keep ESP-NOW on the shared channel, the AP already is on it when it is up
+ */
+void radioPinChannel() {
+  esp_wifi_set_channel(RADIO_CHANNEL, WIFI_SECOND_CHAN_NONE);
+}
+
+void radioSuspendSoftAP() {
+  WiFi.softAPdisconnect(true);
+  radioPinChannel();
+  softAPSuspended = true;
+  softAPSuspensions++;
+}
+
+void radioResumeSoftAP() {
+  WiFi.softAP(ssid, password, RADIO_CHANNEL);
+  WiFi.softAPConfig(ESP32IP, gateway, subnet);
+  softAPSuspended = false;
+}
+
+/**
+ * Apply the coexistence preference for the current policy and hand state
+ */
+void radioApplyPolicy() {
+  bool controlFirst = radioPolicy != RADIO_POLICY_BALANCED && radioHandActive;
+  esp_coex_preference_set(controlFirst ? ESP_COEX_PREFER_BT : ESP_COEX_PREFER_BALANCE);
+
+  bool suspend = !softAPEnabled || (radioPolicy == RADIO_POLICY_SUSPEND_AP && radioHandActive);
+  if (compressedOta.state == OTA_RECEIVING) suspend = false;
+  if (suspend && !softAPSuspended) radioSuspendSoftAP();
+  if (!suspend && softAPSuspended) radioResumeSoftAP();
+}
+
+/**
+ * Should be called once Wi-Fi, ESP-NOW and BLE have all been started
+ */
+void radioCoexBegin() {
+  radioPinChannel();
+  // BLE and Wi-Fi can only share the radio with Wi-Fi modem sleep on
+  esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+  radioApplyPolicy();
+}
+
+void setRadioPolicy(RadioPolicy policy) {
+  radioPolicy = policy;
+  bleReadLatency = {};
+  espNowLatency = {};
+  radioApplyPolicy();
+}
+
+/**
+ * Turn the soft AP on or off for maintenance, turning it on again restarts its timer
+ */
+void setSoftAPEnabled(bool enabled) {
+  softAPEnabled = enabled;
+  softAPEnabledMS = millis();
+  radioApplyPolicy();
+}
+
+/**
+ * Marks the hand as active. Safe to call from the ESP-NOW callback.
+ */
+void radioControlInput() {
+  lastControlInputUS = micros();
+  lastControlInputMS = millis();
+}
+
+/**
+ * Called from the ESP-NOW callback once the packet is queued for the control tick. A packet that arrives before
+ * the previous one was acted on keeps the older stamp, the older packet has waited longer.
+ * @param receivedUS micros() when the callback started
+ */
+void radioEspNowReceived(unsigned long receivedUS) {
+  portENTER_CRITICAL(&espNowLock);
+  if (!espNowPending) espNowReceivedUS = receivedUS;
+  espNowPending = true;
+  portEXIT_CRITICAL(&espNowLock);
+  radioControlInput();
+}
+
+/**
+ * Call at the start of a control tick, before it reads any input. Packets arriving after this wait for the next tick.
+ * @returns true if ESP-NOW packets arrived since the last tick
+ */
+bool radioControlTick() {
+  portENTER_CRITICAL(&espNowLock);
+  bool pending = espNowPending;
+  if (pending) espNowTickReceivedUS = espNowReceivedUS;
+  espNowPending = false;
+  portEXIT_CRITICAL(&espNowLock);
+  espNowInTick = pending;
+  return pending;
+}
+
+/**
+ * Call right after the control tick committed the servo outputs
+ */
+void radioServoCommitted() {
+  if (!espNowInTick) return;
+  espNowInTick = false;
+  espNowLatency.record(micros() - espNowTickReceivedUS);
+}
+
+/**
+ * Switches the soft AP and coexistence preference when the hand goes active or idle and ends the maintenance
+ * window, call it from the main loop
+ */
+void radioCoexLoop() {
+  if (softAPEnabled && millis() - softAPEnabledMS > softAPTimeoutMS && WiFi.softAPgetStationNum() == 0
+      && compressedOta.state != OTA_RECEIVING) {
+    setSoftAPEnabled(false);
+  }
+
+  bool active = millis() - lastControlInputMS < radioActiveHoldMS;
+  if (active == radioHandActive) return;
+  radioHandActive = active;
+  radioApplyPolicy();
+}
+
+void printRadioLatency(const char *name, RadioLatency &latency) {
+  WebSerial.print(name);
+  WebSerial.print(" us (samples/last/avg/max): ");
+  WebSerial.print(latency.samples);
+  WebSerial.print(" / ");
+  WebSerial.print(latency.lastUS);
+  WebSerial.print(" / ");
+  WebSerial.print(latency.samples ? (unsigned long)(latency.totalUS / latency.samples) : 0);
+  WebSerial.print(" / ");
+  WebSerial.println(latency.maxUS);
+}
+
+void printRadioStats() {
+  WebSerial.print("Radio Policy: ");
+  WebSerial.println(radioPolicyNames[radioPolicy]);
+  WebSerial.print("Channel: ");
+  WebSerial.println(RADIO_CHANNEL);
+  WebSerial.print("Hand Active: ");
+  WebSerial.println(radioHandActive ? "yes" : "no");
+  WebSerial.print("Soft AP: ");
+  WebSerial.println(softAPSuspended ? "off" : "on");
+  WebSerial.print("Soft AP Suspensions: ");
+  WebSerial.println(softAPSuspensions);
+  WebSerial.print("Soft AP Stations: ");
+  WebSerial.println(WiFi.softAPgetStationNum());
+  printRadioLatency("BLE Read", bleReadLatency);
+  printRadioLatency("ESP-NOW To Servo", espNowLatency);
+}
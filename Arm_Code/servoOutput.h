@@ -0,0 +1,207 @@
+/**
+  2023-24 Servo Output Stage
+
+  Drives all joints from one place instead of eight independent ESP32Servo objects. Joint positions written
+  during a control tick are only staged, commitServoOutputs() hands all of them to the hardware together.
+
+  Backends:
+    - LedcServoBackend (default): the eight high speed LEDC channels share one 50 Hz timer. Every channel gets
+      its phase offset as the LEDC hpoint, and new duties latch at the start of the next period, so all joints
+      move on the same period.
+    - Pca9685ServoBackend: an external PCA9685 I2C PWM expander. Define USE_PCA9685_SERVOS before including this
+      file to use it. All channels are written in one I2C transaction and the PCA9685 applies them on the STOP.
+
+  Depends on
+  https://docs.espressif.com/projects/esp-idf/en/v4.4/esp32/api-reference/peripherals/ledc.html
+ */
+
+#include <Wire.h>
+#include "driver/ledc.h"
+#include "soc/ledc_struct.h"
+#include "servoSchedule.h"
+#include "jointCalibration.h"
+
+ServoSchedule servoSchedule;
+
+class ServoBackend {
+  public:
+    virtual void begin(ServoSchedule &schedule) = 0;
+    /**
+     * @param jointPhaseUS filled with periodPhaseUS() right after each joint was written, can be nullptr
+     */
+    virtual void write(ServoSchedule &schedule, const uint16_t *pulsesUS, unsigned long *jointPhaseUS) = 0;
+
+    /**
+     * How far into the current servo period the outputs are, used for the skew measurement
+     */
+    virtual unsigned long periodPhaseUS() = 0;
+};
+
+class LedcServoBackend : public ServoBackend {
+  private:
+    static const int dutyBits = 16;
+
+    static uint32_t toTicks(unsigned long us) { return ((uint32_t)us << dutyBits) / SERVO_PERIOD_US; }
+
+  public:
+    void begin(ServoSchedule &schedule) {
+      ledc_timer_config_t timerConfig = {};
+      timerConfig.speed_mode = LEDC_HIGH_SPEED_MODE;
+      timerConfig.duty_resolution = LEDC_TIMER_16_BIT;
+      timerConfig.timer_num = LEDC_TIMER_0;
+      timerConfig.freq_hz = 1000000 / SERVO_PERIOD_US;
+      timerConfig.clk_cfg = LEDC_AUTO_CLK;
+      ledc_timer_config(&timerConfig);
+
+      for (int joint = 0; joint < SERVO_JOINT_COUNT; joint++) {
+        if (schedule.getPin(joint) < 0) continue;
+        ledc_channel_config_t channelConfig = {};
+        channelConfig.gpio_num = schedule.getPin(joint);
+        channelConfig.speed_mode = LEDC_HIGH_SPEED_MODE;
+        channelConfig.channel = (ledc_channel_t)joint;
+        channelConfig.timer_sel = LEDC_TIMER_0;
+        channelConfig.duty = toTicks(schedule.getPulseUS(joint));
+        channelConfig.hpoint = toTicks(schedule.phaseOffsetUS(joint));
+        ledc_channel_config(&channelConfig);
+      }
+
+      ledc_timer_rst(LEDC_HIGH_SPEED_MODE, LEDC_TIMER_0);
+    }
+
+    void write(ServoSchedule &schedule, const uint16_t *pulsesUS, unsigned long *jointPhaseUS) {
+      for (int joint = 0; joint < SERVO_JOINT_COUNT; joint++) {
+        if (schedule.getPin(joint) < 0) continue;
+        ledc_set_duty_with_hpoint(LEDC_HIGH_SPEED_MODE, (ledc_channel_t)joint, toTicks(pulsesUS[joint]), toTicks(schedule.phaseOffsetUS(joint)));
+        ledc_update_duty(LEDC_HIGH_SPEED_MODE, (ledc_channel_t)joint);
+        if (jointPhaseUS) jointPhaseUS[joint] = periodPhaseUS();
+      }
+    }
+
+    // Read straight from the timer counter, it counts 2^dutyBits steps per period
+    unsigned long periodPhaseUS() {
+      uint32_t count = LEDC.timer_group[LEDC_HIGH_SPEED_MODE].timer[LEDC_TIMER_0].value.timer_cnt;
+      return ((uint32_t)count * SERVO_PERIOD_US) >> dutyBits;
+    }
+};
+
+class Pca9685ServoBackend : public ServoBackend {
+  private:
+    uint8_t address;
+    unsigned long oscillatorStartUS = 0;
+
+    static const uint8_t MODE1 = 0x00;
+    static const uint8_t LED0_ON_L = 0x06;
+    static const uint8_t PRESCALE = 0xFE;
+
+    static uint16_t toCounts(unsigned long us) { return (uint16_t)(((uint32_t)us * 4096) / SERVO_PERIOD_US); }
+
+    void writeRegister(uint8_t reg, uint8_t value) {
+      Wire.beginTransmission(address);
+      Wire.write(reg);
+      Wire.write(value);
+      Wire.endTransmission();
+    }
+
+  public:
+    Pca9685ServoBackend(uint8_t address = 0x40) : address(address) {}
+
+    void begin(ServoSchedule &schedule) {
+      Wire.begin();
+      Wire.setClock(400000);
+
+      writeRegister(MODE1, 0x10);  // sleep, needed to change the prescaler
+      writeRegister(PRESCALE, (uint8_t)(25000000L / (4096L * (1000000L / SERVO_PERIOD_US)) - 1));
+      writeRegister(MODE1, 0x20);  // wake up with register auto increment
+      delayMicroseconds(500);
+      writeRegister(MODE1, 0xA0);  // restart the PWM channels
+      oscillatorStartUS = micros();
+
+      write(schedule, nullptr, nullptr);
+    }
+
+    void write(ServoSchedule &schedule, const uint16_t *pulsesUS, unsigned long *jointPhaseUS) {
+      // Joint N is wired to PCA9685 channel N
+      Wire.beginTransmission(address);
+      Wire.write(LED0_ON_L);
+      for (int joint = 0; joint < SERVO_JOINT_COUNT; joint++) {
+        uint16_t pulseUS = pulsesUS ? pulsesUS[joint] : schedule.getPulseUS(joint);
+        uint16_t on = toCounts(schedule.phaseOffsetUS(joint));
+        uint16_t off = on + toCounts(pulseUS);
+        if (pulseUS == 0) off = 0x1000;  // full off bit
+        Wire.write(on & 0xFF);
+        Wire.write(on >> 8);
+        Wire.write(off & 0xFF);
+        Wire.write(off >> 8);
+      }
+      Wire.endTransmission();
+
+      // Every channel takes its new value on the STOP
+      unsigned long phaseUS = periodPhaseUS();
+      for (int joint = 0; jointPhaseUS && joint < SERVO_JOINT_COUNT; joint++) jointPhaseUS[joint] = phaseUS;
+    }
+
+    // The PCA9685 counter cannot be read back and runs from its own oscillator, treat this as an estimate
+    unsigned long periodPhaseUS() { return (micros() - oscillatorStartUS) % SERVO_PERIOD_US; }
+};
+
+#ifdef USE_PCA9685_SERVOS
+Pca9685ServoBackend servoBackendDevice;
+#else
+LedcServoBackend servoBackendDevice;
+#endif
+ServoBackend *servoBackend = &servoBackendDevice;
+
+/**
+ * Stand in for the ESP32Servo Servo class. write() only stages the joint position, nothing moves until
+ * commitServoOutputs() runs at the end of the control tick.
+ * Joints with a calibration table (see jointCalibration.h) are moved with writePosition() instead of angles.
+ */
+class JointServo {
+  private:
+    uint8_t joint;
+    const JointTable *calibration;
+    float position = -1;
+
+  public:
+    JointServo(uint8_t joint, const JointTable *calibration = nullptr) : joint(joint), calibration(calibration) {}
+
+    void attach(int pin) { servoSchedule.setPin(joint, pin); }
+    void write(int degrees) { servoSchedule.stage(joint, ServoSchedule::degreesToPulseUS(degrees)); }
+    void writeMicroseconds(int pulseUS) { servoSchedule.stage(joint, pulseUS); }
+
+    /**
+     * Move to a position through the joint's calibration table
+     * @param newPosition 0 = open, 1 = closed
+     */
+    void writePosition(float newPosition) {
+      if (!calibration) return;
+      position = newPosition < 0 ? 0 : newPosition > 1 ? 1 : newPosition;
+      servoSchedule.stage(joint, jointPulseUS(*calibration, position));
+    }
+
+    // Last position given to writePosition(), -1 until then
+    float readPosition() { return position; }
+};
+
+/**
+ * Start the PWM outputs. Should be called once every joint has been attached.
+ */
+void servoOutputBegin() {
+  servoSchedule.commit();
+  servoBackend->begin(servoSchedule);
+}
+
+/**
+ * Send every joint position staged during this control tick to the servos together
+ */
+void commitServoOutputs() {
+  if (!servoSchedule.hasChanges()) return;
+
+  const uint16_t *pulsesUS = servoSchedule.commit();
+  unsigned long jointPhaseUS[SERVO_JOINT_COUNT] = {};
+  unsigned long commitPhaseUS = servoBackend->periodPhaseUS();
+  unsigned long commitStartUS = micros();
+  servoBackend->write(servoSchedule, pulsesUS, jointPhaseUS);
+  unsigned long commitUS = micros() - commitStartUS;
+  servoSchedule.recordCommit(commitPhaseUS, jointPhaseUS, commitUS);
+}
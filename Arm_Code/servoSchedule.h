@@ -0,0 +1,172 @@
+/**
+  2023-24 Servo Output Scheduling
+
+  Keeps the pulse width of every joint in one place so all of them can be committed at the same control tick.
+  Joints are staged during the tick (write()) and handed to the output backend together (commit()).
+  Each joint also gets a phase offset inside the 20 ms servo period so their pulses do not all start at the
+  same moment, which spreads out the current spikes on the servo supply.
+
+  Skew:
+    - The stagger is by design, every commit spreads the joints over configuredSpreadUS().
+    - What is measured is when each joint really takes its new pulse width. The backend reads the PWM timer
+      right after writing each joint, a joint latches at the first period start after that. A commit that
+      crosses a period start leaves the joints written after it one period behind, that extra skew is what
+      jointSkewUS shows on top of the configured spread.
+
+  Nothing in here touches the hardware, the backends in servoOutput.h do that, so it can be compiled on a host.
+ */
+
+#include <stdint.h>
+
+#define SERVO_JOINT_COUNT 8
+#define SERVO_PERIOD_US 20000
+
+// Same pulse range ESP32Servo uses for write(degrees), so existing positions keep their meaning
+#define SERVO_MIN_PULSE_US 544
+#define SERVO_MAX_PULSE_US 2400
+
+enum ServoJoint : uint8_t {
+  JOINT_THUMB = 0,
+  JOINT_THUMB_BASE,
+  JOINT_INDEX,
+  JOINT_MIDDLE,
+  JOINT_RING,
+  JOINT_PINK,
+  JOINT_ROTATION,
+  JOINT_BENDING
+};
+
+struct ServoSkewStats {
+  unsigned long commits;
+  unsigned long splitCommits;      // commits that crossed a period boundary, some joints moved one period late
+  unsigned long lastCommitUS;      // time spent handing one tick to the backend
+  unsigned long maxCommitUS;
+  unsigned long tickToPulseMinUS;  // from the commit to the first joint pulse that carries it, last commit
+  unsigned long tickToPulseMaxUS;  // from the commit to the last joint pulse that carries it, last commit
+  unsigned long jointSkewUS;       // tickToPulseMaxUS - tickToPulseMinUS of the last commit
+  unsigned long maxJointSkewUS;
+};
+
+class ServoSchedule {
+  private:
+    int pins[SERVO_JOINT_COUNT];
+    uint16_t staged[SERVO_JOINT_COUNT];
+    uint16_t committed[SERVO_JOINT_COUNT];
+    bool dirty = false;
+    uint16_t staggerUS;
+    ServoSkewStats stats = {};
+
+  public:
+    ServoSchedule(uint16_t staggerUS = 500) : staggerUS(staggerUS) {
+      for (int i = 0; i < SERVO_JOINT_COUNT; i++) {
+        pins[i] = -1;
+        staged[i] = 0;
+        committed[i] = 0;
+      }
+    }
+
+    /**
+     * Convert a servo angle to a pulse width the same way Servo::write() does
+     */
+    static uint16_t degreesToPulseUS(int degrees) {
+      if (degrees < 0) degrees = 0;
+      if (degrees > 180) degrees = 180;
+      return SERVO_MIN_PULSE_US + (long)degrees * (SERVO_MAX_PULSE_US - SERVO_MIN_PULSE_US) / 180;
+    }
+
+    void setPin(uint8_t joint, int pin) {
+      if (joint < SERVO_JOINT_COUNT) pins[joint] = pin;
+    }
+    int getPin(uint8_t joint) { return joint < SERVO_JOINT_COUNT ? pins[joint] : -1; }
+
+    /**
+     * Stage a pulse width for the next commit. A pulse width of 0 keeps the output low.
+     */
+    void stage(uint8_t joint, uint16_t pulseUS) {
+      if (joint >= SERVO_JOINT_COUNT) return;
+      if (pulseUS != 0 && pulseUS < SERVO_MIN_PULSE_US) pulseUS = SERVO_MIN_PULSE_US;
+      if (pulseUS > SERVO_MAX_PULSE_US) pulseUS = SERVO_MAX_PULSE_US;
+      if (staged[joint] == pulseUS) return;
+      staged[joint] = pulseUS;
+      dirty = true;
+    }
+
+    bool hasChanges() { return dirty; }
+    uint16_t getStagedPulseUS(uint8_t joint) { return joint < SERVO_JOINT_COUNT ? staged[joint] : 0; }
+
+    /**
+     * Take every staged pulse width at once.
+     * @returns the committed pulse widths, indexed by ServoJoint
+     */
+    const uint16_t *commit() {
+      for (int i = 0; i < SERVO_JOINT_COUNT; i++) committed[i] = staged[i];
+      dirty = false;
+      return committed;
+    }
+
+    uint16_t getPulseUS(uint8_t joint) { return joint < SERVO_JOINT_COUNT ? committed[joint] : 0; }
+
+    /**
+     * Where the pulse of a joint starts inside the servo period
+     */
+    uint16_t phaseOffsetUS(uint8_t joint) { return joint * staggerUS; }
+
+    void setStaggerUS(uint16_t newStaggerUS) {
+      // The last joint still has to fit its longest pulse inside the period
+      if ((long)newStaggerUS * (SERVO_JOINT_COUNT - 1) + SERVO_MAX_PULSE_US > SERVO_PERIOD_US) return;
+      staggerUS = newStaggerUS;
+    }
+    uint16_t getStaggerUS() { return staggerUS; }
+
+    /**
+     * Spread between the first and last attached joint that the stagger puts in on purpose
+     */
+    unsigned long configuredSpreadUS() {
+      int first = -1;
+      int last = -1;
+      for (int i = 0; i < SERVO_JOINT_COUNT; i++) {
+        if (pins[i] < 0) continue;
+        if (first < 0) first = i;
+        last = i;
+      }
+      return first < 0 ? 0 : phaseOffsetUS(last) - phaseOffsetUS(first);
+    }
+
+    /**
+     * Record how one commit went. Joints are written in ServoJoint order.
+     * @param commitPhaseUS period phase read from the PWM timer when the backend started writing
+     * @param jointPhaseUS period phase read from the PWM timer right after each joint was written, indexed by ServoJoint
+     * @param commitUS time the backend spent writing, has to be shorter than a period
+     */
+    void recordCommit(unsigned long commitPhaseUS, const unsigned long *jointPhaseUS, unsigned long commitUS) {
+      stats.commits++;
+      stats.lastCommitUS = commitUS;
+      if (commitUS > stats.maxCommitUS) stats.maxCommitUS = commitUS;
+
+      unsigned long first = 0;
+      unsigned long last = 0;
+      bool any = false;
+      bool split = false;
+      unsigned long previousPhaseUS = commitPhaseUS;
+      for (int i = 0; i < SERVO_JOINT_COUNT; i++) {
+        if (pins[i] < 0) continue;
+        // The phase only goes down when the timer started a new period since the last reading
+        if (jointPhaseUS[i] < previousPhaseUS) split = true;
+        previousPhaseUS = jointPhaseUS[i];
+
+        // Latched at the next period start, then the joint waits for its own phase offset
+        unsigned long delayUS = (split ? 2 : 1) * (unsigned long)SERVO_PERIOD_US - commitPhaseUS + phaseOffsetUS(i);
+        if (!any || delayUS < first) first = delayUS;
+        if (!any || delayUS > last) last = delayUS;
+        any = true;
+      }
+
+      if (split) stats.splitCommits++;
+      stats.tickToPulseMinUS = first;
+      stats.tickToPulseMaxUS = last;
+      stats.jointSkewUS = last - first;
+      if (stats.jointSkewUS > stats.maxJointSkewUS) stats.maxJointSkewUS = stats.jointSkewUS;
+    }
+
+    ServoSkewStats getStats() { return stats; }
+};
@@ -0,0 +1,333 @@
+/**
+  2023-24 Toe Gesture Recognizer
+
+  Table driven state machine that turns timestamped toe press/release edges into gestures.
+  It does not touch any Arduino API, every function is handed the current time, so it can be
+  compiled and fed recorded edges on a host machine.
+
+  Steps:
+    - Tap: a toe is pressed and released within @param tapMaxMS while the other toe is up.
+    - Hold: a toe stays pressed for @param longPressMS. The step is produced while the toe is still down.
+    - Chord: both toes go down within @param chordWindowMS of each other and one comes up again before
+      @param longPressMS. The step is produced on that release.
+    - Chord hold: both toes go down together and stay down for @param longPressMS. The step is produced while
+      they are still down.
+
+  A gesture is a list of up to TOE_GESTURE_MAX_STEPS steps, so a double tap is { Tap, Tap } and
+  "big toe then small toes" is { Tap Big, Tap Small }. Each new step must arrive within
+  @param sequenceWindowMS of the previous one.
+
+  Latency:
+    - A gesture that is not the beginning of a longer gesture in the table fires on the edge that completes it.
+    - A gesture that is also the beginning of a longer one is ambiguous. It only fires once the next step
+      rules out the longer gesture or @param sequenceWindowMS runs out. Keep the table free of these when possible.
+    - Every fired gesture reports @param latencyMS, the time from its last step to the decision.
+
+  Threads:
+    - The recognizer itself is not locked. Edges come in from the radio callbacks on another core, so they go
+      through a ToeEdgeQueue (guarded by the caller) and are handed to edge() from the control loop.
+    - An edge can still carry a timestamp a little after the @param now the loop last sampled. update() treats
+      such a press as just started instead of as held for a very long time.
+ */
+
+#include <stdint.h>
+
+#define TOE_GESTURE_MAX_STEPS 3
+#define TOE_GESTURE_QUEUE_SIZE 4
+#define TOE_EDGE_QUEUE_SIZE 8
+
+enum ToeId : uint8_t {
+  BIG_TOE = 0,
+  SMALL_TOE = 1
+};
+
+enum ToeGestureStep : uint8_t {
+  STEP_NONE = 0,
+  STEP_TAP_BIG,
+  STEP_TAP_SMALL,
+  STEP_HOLD_BIG,
+  STEP_HOLD_SMALL,
+  STEP_CHORD,
+  STEP_HOLD_CHORD
+};
+
+enum ToeGestureAction : uint8_t {
+  ACTION_NONE = 0,
+  ACTION_NEXT_MODE,      // fingerType + 1
+  ACTION_PREVIOUS_MODE,  // fingerType - 1
+  ACTION_SET_MODE,       // fingerType = value
+  ACTION_WRIST_LOCK,     // toggles the wrist lock
+  ACTION_MAINTENANCE     // toggles the maintenance soft AP
+};
+
+struct ToeGestureRule {
+  ToeGestureStep steps[TOE_GESTURE_MAX_STEPS];  // unused steps are left as STEP_NONE
+  ToeGestureAction action;
+  int value;
+  const char *name;
+};
+
+struct ToeGestureTiming {
+  unsigned long tapMaxMS;
+  unsigned long longPressMS;
+  unsigned long chordWindowMS;
+  unsigned long sequenceWindowMS;
+};
+
+struct ToeGestureEvent {
+  ToeGestureAction action;
+  int value;
+  const char *name;
+  unsigned long latencyMS;
+};
+
+const ToeGestureTiming defaultToeGestureTiming = { 400, 800, 120, 2000 };
+
+class ToeGestureRecognizer {
+  private:
+    const ToeGestureRule *rules;
+    int ruleCount;
+    ToeGestureTiming timing;
+
+    // Per toe state, indexed by ToeId
+    bool down[2] = { false, false };
+    bool consumed[2] = { false, false };  // press already used by a chord or a hold, its release is not a tap
+    unsigned long pressedAt[2] = { 0, 0 };
+    bool chordDown = false;  // both toes went down together, a chord or a chord hold once decided
+    unsigned long chordAt = 0;
+
+    // Steps collected so far for the gesture in progress
+    ToeGestureStep steps[TOE_GESTURE_MAX_STEPS];
+    int stepCount = 0;
+    unsigned long lastStepAt = 0;
+    int pendingRule = -1;  // exact match that is waiting to rule out a longer gesture
+
+    ToeGestureEvent queue[TOE_GESTURE_QUEUE_SIZE];
+    int queueHead = 0;
+    int queueCount = 0;
+
+    static int ruleLength(const ToeGestureRule &rule) {
+      int length = 0;
+      while (length < TOE_GESTURE_MAX_STEPS && rule.steps[length] != STEP_NONE) length++;
+      return length;
+    }
+
+    bool ruleStartsWithSteps(const ToeGestureRule &rule) {
+      for (int i = 0; i < stepCount; i++) {
+        if (rule.steps[i] != steps[i]) return false;
+      }
+      return true;
+    }
+
+    void clearSteps() {
+      stepCount = 0;
+      pendingRule = -1;
+    }
+
+    void dropOldestStep() {
+      for (int i = 1; i < stepCount; i++) steps[i - 1] = steps[i];
+      stepCount--;
+    }
+
+    void fire(int ruleIndex, unsigned long latencyMS) {
+      if (queueCount == TOE_GESTURE_QUEUE_SIZE) {
+        // Nobody is polling, keep the newest gestures
+        queueHead = (queueHead + 1) % TOE_GESTURE_QUEUE_SIZE;
+        queueCount--;
+      }
+      ToeGestureEvent &event = queue[(queueHead + queueCount) % TOE_GESTURE_QUEUE_SIZE];
+      event.action = rules[ruleIndex].action;
+      event.value = rules[ruleIndex].value;
+      event.name = rules[ruleIndex].name;
+      event.latencyMS = latencyMS;
+      queueCount++;
+    }
+
+    /**
+     * Looks the collected steps up in the table.
+     * @returns false if no gesture in the table starts with the collected steps
+     */
+    bool resolve(unsigned long now) {
+      int exact = -1;
+      bool longer = false;
+
+      for (int i = 0; i < ruleCount; i++) {
+        int length = ruleLength(rules[i]);
+        if (length < stepCount || !ruleStartsWithSteps(rules[i])) continue;
+        if (length == stepCount) {
+          if (exact < 0) exact = i;
+        } else {
+          longer = true;
+        }
+      }
+
+      if (exact >= 0 && !longer) {
+        fire(exact, now - lastStepAt);
+        clearSteps();
+        return true;
+      }
+
+      pendingRule = exact;
+      return exact >= 0 || longer;
+    }
+
+    void pushStep(ToeGestureStep step, unsigned long stepAt, unsigned long now) {
+      if (stepCount > 0 && stepAt > lastStepAt && stepAt - lastStepAt > timing.sequenceWindowMS) {
+        expire(now);
+      }
+
+      int previousPending = pendingRule;
+      unsigned long previousStepAt = lastStepAt;
+      if (stepCount == TOE_GESTURE_MAX_STEPS) dropOldestStep();
+      steps[stepCount++] = step;
+      lastStepAt = stepAt;
+
+      if (resolve(now)) return;
+
+      // The new step broke the gesture in progress. Fire what was already complete and start over from the new step.
+      if (previousPending >= 0) fire(previousPending, now - previousStepAt);
+      while (stepCount > 1) {
+        dropOldestStep();
+        if (resolve(now)) return;
+      }
+      clearSteps();
+    }
+
+    void expire(unsigned long now) {
+      if (pendingRule >= 0) fire(pendingRule, now - lastStepAt);
+      clearSteps();
+    }
+
+  public:
+    ToeGestureRecognizer(const ToeGestureRule *rules, int ruleCount, ToeGestureTiming timing = defaultToeGestureTiming)
+      : rules(rules), ruleCount(ruleCount), timing(timing) {}
+
+    /**
+     * Feed a toe edge. Repeated values for the same toe are ignored, so this can be handed every received payload.
+     * @param toe BIG_TOE or SMALL_TOE
+     * @param pressed true when the toe went down
+     * @param now timestamp of the edge in ms
+     */
+    void edge(uint8_t toe, bool pressed, unsigned long now) {
+      if (toe > SMALL_TOE || down[toe] == pressed) return;
+      uint8_t other = 1 - toe;
+      down[toe] = pressed;
+
+      if (pressed) {
+        pressedAt[toe] = now;
+        consumed[toe] = false;
+        if (down[other]) {
+          consumed[toe] = true;
+          if (!consumed[other] && now - pressedAt[other] <= timing.chordWindowMS) {
+            consumed[other] = true;
+            chordDown = true;
+            chordAt = now;
+          }
+        }
+        return;
+      }
+
+      if (chordDown) {
+        // Let go before update() saw the chord held
+        chordDown = false;
+        if (now >= chordAt && now - chordAt >= timing.longPressMS) pushStep(STEP_HOLD_CHORD, chordAt + timing.longPressMS, now);
+        else pushStep(STEP_CHORD, now, now);
+        return;
+      }
+      if (consumed[toe]) return;
+      if (now - pressedAt[toe] <= timing.tapMaxMS) {
+        pushStep(toe == BIG_TOE ? STEP_TAP_BIG : STEP_TAP_SMALL, now, now);
+      }
+    }
+
+    /**
+     * Produces hold steps and times out ambiguous gestures. Should be called every control tick.
+     */
+    void update(unsigned long now) {
+      for (uint8_t toe = BIG_TOE; toe <= SMALL_TOE; toe++) {
+        // A press stamped after now has only just started
+        if (!down[toe] || consumed[toe] || now < pressedAt[toe] || now - pressedAt[toe] < timing.longPressMS) continue;
+        consumed[toe] = true;
+        pushStep(toe == BIG_TOE ? STEP_HOLD_BIG : STEP_HOLD_SMALL, pressedAt[toe] + timing.longPressMS, now);
+      }
+      if (chordDown && now >= chordAt && now - chordAt >= timing.longPressMS) {
+        chordDown = false;
+        pushStep(STEP_HOLD_CHORD, chordAt + timing.longPressMS, now);
+      }
+
+      if (stepCount > 0 && now > lastStepAt && now - lastStepAt > timing.sequenceWindowMS) {
+        expire(now);
+      }
+    }
+
+    /**
+     * Takes the oldest recognized gesture.
+     * @returns false if no gesture is waiting
+     */
+    bool poll(ToeGestureEvent &event) {
+      if (queueCount == 0) return false;
+      event = queue[queueHead];
+      queueHead = (queueHead + 1) % TOE_GESTURE_QUEUE_SIZE;
+      queueCount--;
+      return true;
+    }
+
+    bool isToeDown(uint8_t toe) { return toe <= SMALL_TOE && down[toe]; }
+
+    void setTiming(ToeGestureTiming newTiming) { timing = newTiming; }
+    ToeGestureTiming getTiming() { return timing; }
+};
+
+struct ToeEdge {
+  uint8_t toe;
+  bool pressed;
+  unsigned long at;  // ms
+};
+
+/**
+ * Toe edges waiting for the control loop. The caller guards push() and pop() with a lock, since push() is called
+ * from the radio callbacks.
+ */
+class ToeEdgeQueue {
+  private:
+    ToeEdge edges[TOE_EDGE_QUEUE_SIZE];
+    int head = 0;
+    int count = 0;
+    bool lastPressed[2] = { false, false };
+    unsigned long dropped = 0;
+
+  public:
+    /**
+     * Queue an edge. Repeated values for the same toe are ignored, so this can be handed every received payload.
+     * @returns false if the edge was ignored or the queue was full
+     */
+    bool push(uint8_t toe, bool pressed, unsigned long at) {
+      if (toe > SMALL_TOE || lastPressed[toe] == pressed) return false;
+      if (count == TOE_EDGE_QUEUE_SIZE) {
+        // Not remembered as sent, so the next payload that still carries it queues it again
+        dropped++;
+        return false;
+      }
+      lastPressed[toe] = pressed;
+      ToeEdge &edge = edges[(head + count) % TOE_EDGE_QUEUE_SIZE];
+      edge.toe = toe;
+      edge.pressed = pressed;
+      edge.at = at;
+      count++;
+      return true;
+    }
+
+    /**
+     * Takes the oldest edge.
+     * @returns false if the queue is empty
+     */
+    bool pop(ToeEdge &edge) {
+      if (count == 0) return false;
+      edge = edges[head];
+      head = (head + 1) % TOE_EDGE_QUEUE_SIZE;
+      count--;
+      return true;
+    }
+
+    unsigned long getDropped() { return dropped; }
+};
@@ -0,0 +1,91 @@
+/**
+  2023-24 Toe Pressure Mapping
+
+  Turns the toe pressures sent by the Foot Controller or Foot Sleeve in pressure mode (0 to 255) into
+  virtual button presses for the mode and gesture logic, and into a speed for the grips.
+  It does not touch any Arduino API, so it can be compiled and fed recorded pressures on a host machine.
+
+  Virtual buttons:
+    - A toe is pressed once its pressure reaches @param pressThreshold and released once it drops to
+      @param releaseThreshold. The gap between the two keeps a wobbling toe from chattering.
+
+  Grip modes, only for presses the pressure made (see press()). A toe button on the other foot unit keeps
+  moving the hand at button speed:
+    - PRESSURE_GRIP_VELOCITY: harder presses close (big toe) or open (small toes) the hand faster, from
+      @param minSpeed just past the release threshold up to @param maxSpeed at full pressure.
+    - PRESSURE_GRIP_TARGET: the pressure sets how far the hand closes or opens, it stops there until the
+      pressure goes up.
+ */
+
+#include <stdint.h>
+
+enum PressureGripMode : uint8_t {
+  PRESSURE_GRIP_VELOCITY = 0,
+  PRESSURE_GRIP_TARGET
+};
+
+struct ToePressureSettings {
+  uint8_t pressThreshold;
+  uint8_t releaseThreshold;
+  float minSpeed;  // 1 is the speed the buttons move the hand at
+  float maxSpeed;
+};
+
+const ToePressureSettings defaultToePressureSettings = { 80, 40, 0.25, 2.0 };
+
+class ToePressureMapper {
+  private:
+    ToePressureSettings settings;
+    uint8_t pressure[2] = { 0, 0 };
+    bool down[2] = { false, false };
+    bool pressedByPressure[2] = { false, false };  // where the toe's latest press came from
+
+  public:
+    PressureGripMode mode = PRESSURE_GRIP_VELOCITY;
+
+    ToePressureMapper(ToePressureSettings settings = defaultToePressureSettings) : settings(settings) {}
+
+    /**
+     * Feed one pressure reading
+     * @param toe 0 for the big toe, 1 for the small toes
+     * @returns true when the toe's virtual button changed, isDown() has the new state
+     */
+    bool sample(uint8_t toe, uint8_t value) {
+      if (toe > 1) return false;
+      pressure[toe] = value;
+
+      bool nowDown = down[toe] ? value > settings.releaseThreshold : value >= settings.pressThreshold;
+      if (nowDown == down[toe]) return false;
+      down[toe] = nowDown;
+      return true;
+    }
+
+    /**
+     * Note where a toe press came from, call it for every press whether it came from a button or from sample()
+     */
+    void press(uint8_t toe, bool fromPressure) {
+      if (toe <= 1) pressedByPressure[toe] = fromPressure;
+    }
+
+    bool isDown(uint8_t toe) { return toe <= 1 && down[toe]; }
+    bool isPressedByPressure(uint8_t toe) { return toe <= 1 && pressedByPressure[toe]; }
+    uint8_t getPressure(uint8_t toe) { return toe <= 1 ? pressure[toe] : 0; }
+
+    /**
+     * Pressure above the release threshold, from 0 to 1
+     */
+    float level(uint8_t toe) {
+      if (toe > 1 || pressure[toe] <= settings.releaseThreshold) return 0;
+      return (float)(pressure[toe] - settings.releaseThreshold) / (255 - settings.releaseThreshold);
+    }
+
+    /**
+     * Speed for the grip or release a toe drives, multiplies the button step sizes. 1 for a button press.
+     * @param progress how far the grip (big toe) or release (small toes) has got, from 0 to 1
+     */
+    float speed(uint8_t toe, float progress) {
+      if (!isPressedByPressure(toe)) return 1;
+      if (mode == PRESSURE_GRIP_TARGET) return progress < level(toe) ? 1 : 0;
+      return settings.minSpeed + level(toe) * (settings.maxSpeed - settings.minSpeed);
+    }
+};
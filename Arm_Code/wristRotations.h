@@ -7,17 +7,18 @@
 short rotationDirection = 0;
 short bendingDirection = 0;
 short pos = 0;
+bool wristLocked = false; // Toggled by a toe gesture, holds the wrist where it is
 
 // Wrist Rotation Servo
 int rotationPin = 22; //22
-Servo rotationServo;
+JointServo rotationServo(JOINT_ROTATION);
 int minRotationMotorPos = 30;
 int maxRotationMotorPos = 130;
 float rotationMotorPos = (minRotationMotorPos + maxRotationMotorPos) / 2;
 
 // Wrist Bending Servo
 int bendingPin = 21;
-Servo bendingServo;
+JointServo bendingServo(JOINT_BENDING);
 int minBendingMotorPos = 10;
 int maxBendingMotorPos = 40;
 float bendingMotorPos = (minBendingMotorPos + maxBendingMotorPos) / 2;
@@ -28,6 +29,9 @@ float bendingMotorPos = (minBendingMotorPos + maxBendingMotorPos) / 2;
  * @param direction -1 for down, 1 for up
  */
 void moveWristBend(short direction) {
+  PROFILE_SCOPE("moveWristBend");
+
+  if (wristLocked) return;
 
   if (direction == 0) {
     //Serial.println("Stop Bend");
@@ -36,8 +40,11 @@ void moveWristBend(short direction) {
   }
 
   if (direction == -1){
-    Serial.println("Bend_Down");
-    WebSerial.println("Bend Down");
+    {
+      PROFILE_SCOPE("print");
+      Serial.println("Bend_Down");
+      WebSerial.println("Bend Down");
+    }
 
           bendingServo.write(bendingMotorPos);
 
@@ -51,8 +58,11 @@ void moveWristBend(short direction) {
       }
       
   if (direction == 1){
-    Serial.println("Bend_Up");
-    WebSerial.println("Bend Up");
+    {
+      PROFILE_SCOPE("print");
+      Serial.println("Bend_Up");
+      WebSerial.println("Bend Up");
+    }
 
           bendingServo.write(bendingMotorPos);
           //delay(20); // waits 15 ms for the servo to reach the position 
@@ -73,6 +83,9 @@ void moveWristBend(short direction) {
  * @param direction -1 for left, 1 for right
  */
 void moveWristRotation(short direction) {
+  PROFILE_SCOPE("moveWristRotation");
+
+  if (wristLocked) return;
 
   if (direction == 0) {
     //Serial.println("Stopped");
@@ -81,8 +94,11 @@ void moveWristRotation(short direction) {
   }
 
   if (direction == 1){
-    Serial.println("Rotate_Left");
-    WebSerial.println("Rotate Left");
+    {
+      PROFILE_SCOPE("print");
+      Serial.println("Rotate_Left");
+      WebSerial.println("Rotate Left");
+    }
 
           rotationServo.write(rotationMotorPos);
 
@@ -96,8 +112,11 @@ void moveWristRotation(short direction) {
       }
       
   if (direction == -1){
-    Serial.println("Rotate_Right");
-    WebSerial.println("Rotate Right");
+    {
+      PROFILE_SCOPE("print");
+      Serial.println("Rotate_Right");
+      WebSerial.println("Rotate Right");
+    }
 
           rotationServo.write(rotationMotorPos);
 
@@ -55,6 +55,8 @@ void startReadingBatteryLevel(nrf_saadc_value_t* buffer) {
 
 nrf_saadc_value_t BatteryLevel = { 0 };
 
+void update_battery_level(void);
+
 float vBat = 0.0;
 float batPercent = 0.0;
 
@@ -73,6 +75,15 @@ void monitor_battery_level(void) {
   if (nrf_saadc_event_check(NRF_SAADC_EVENT_DONE)){
     // ADC conversion completed. Reading is stored in BatteryLevel
     nrf_saadc_event_clear(NRF_SAADC_EVENT_DONE);
+    update_battery_level();
+  }
+}
+
+/*
+* Works out the charge from BatteryLevel and sets the LED colors. Called by monitor_battery_level(), or with a
+* reading from the pressure scan while that owns the ADC (see FsrPressure.h).
+*/
+void update_battery_level(void) {
      vBat = ((float)BatteryLevel / 4096 * 3.3 / 510 * (1000 + 510)); 
 
      batPercent = 100 - (((4.0 - vBat)/vBat)*100);
@@ -111,7 +122,6 @@ void monitor_battery_level(void) {
       pinMode (P0_13, OUTPUT);
       digitalWrite(P0_13, LOW); // The battery charging current is selectable as 50mA or 100mA -> HIGH = 50mA, LOW = 100mA
     }
-  }
 }
 void setupBatteryLevel() {
 
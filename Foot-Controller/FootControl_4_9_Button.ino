@@ -6,6 +6,10 @@ Button Pins:
 Four toes: 8
 Big toe: 9 
 
+Pressure Mode (toePressureMode):
+Force sensitive resistors on the same toe positions, big toe on A0, four toes on A1 (see FsrPressure.h).
+The payload carries the toe pressures instead of button edges and the arm works out the presses.
+
 Depends on
 https://github.com/Seeed-Studio/Seeed_Arduino_LSM6DS3
 Intallation instuctions for SeeedBoards - https://wiki.seeedstudio.com/XIAO_BLE/
@@ -16,6 +20,7 @@ Intallation instuctions for SeeedBoards - https://wiki.seeedstudio.com/XIAO_BLE/
 #include <ArduinoBLE.h>
 #include "SeeedAcceloTrigger.h"
 #include "BatteryCharger.h"
+#include "FsrPressure.h"
 
 SeeedAcceloTrigger* acceloTrigger;
 
@@ -26,6 +31,12 @@ short prevBtnValues[numBtnPins];
 
 bool systemActive = true;
 bool debugMode = true;
+bool sensorOffload = true;     // let the IMU watch for motion while the foot is still
+int offloadIdleDelayMS = 10;  // MCU sleeps this long per loop while offloaded, toe presses wait at most this much
+bool toePressureMode = false;  // read the toes as pressure instead of buttons
+int pressureDeadband = 2;      // smallest pressure change worth a notification
+
+FsrPressure fsrPressure;
 
 // Define the structure to store the received data
 struct payloadStruct {
@@ -35,11 +46,38 @@ struct payloadStruct {
   float pitchValue;
   float footYaw;
   float yawValue;
+  uint8_t pressureMode;    // 1 when toePressure carries the toes and footButton is -1
+  uint8_t toePressure[2];  // big toe, four toes, 0 to 255
 } payloadData;
 
 BLEService customService("19B10000-E8F2-537E-4F6C-D104768A1214");
 BLECharacteristic customCharacteristic("19b10001-e8f2-537e-4f6c-d104768a1214", BLENotify | BLEWrite | BLERead, sizeof(payloadStruct));
 
+// Notifications
+// Connection interval asked from the arm, in 1.25 ms units
+int minConnectionInterval = 6;
+int maxConnectionInterval = 12;
+bool payloadDirty = false;
+unsigned long notificationsSent = 0;
+unsigned long notificationsCoalesced = 0;
+unsigned long notificationsFailed = 0;
+
+// Button edges waiting for their turn in the payload, see publishPayload()
+#define BUTTON_EDGE_QUEUE_SIZE 8
+struct ButtonEdge {
+  uint8_t button;
+  uint8_t value;
+};
+ButtonEdge buttonEdges[BUTTON_EDGE_QUEUE_SIZE];
+int buttonEdgeHead = 0;
+int buttonEdgeCount = 0;
+unsigned long edgeHoldMS = 30;  // two of the longest connection intervals, so the arm reads every edge at least once
+unsigned long lastEdgeMS = 0;
+unsigned long buttonEdgesSent = 0;
+unsigned long buttonEdgesDropped = 0;  // queue full, the edge is read again from the pin next loop
+unsigned long maxEdgeWaitMS = 0;
+unsigned long edgeQueuedMS[BUTTON_EDGE_QUEUE_SIZE];
+
 void setup() {
 
   if (debugMode) {
@@ -53,6 +91,7 @@ void setup() {
   }
 
   BLE.setLocalName("SEEED");
+  BLE.setConnectionInterval(minConnectionInterval, maxConnectionInterval);
   BLE.setAdvertisedService(customService);
 
   customService.addCharacteristic(customCharacteristic);
@@ -69,6 +108,13 @@ void setup() {
   //Setting up battery charger
   setupBatteryLevel();
 
+  // The pressure scan takes over the ADC, so it has to start after the battery setup
+  if (toePressureMode) {
+    fsrPressure.begin();
+    payloadData.footButton = -1;
+    payloadData.pressureMode = 1;
+  }
+
   // Set IMU callbacks
   acceloTrigger = new SeeedAcceloTrigger();
   acceloTrigger->setOnPitchRestCallback(onPitchRestCallback);
@@ -76,6 +122,12 @@ void setup() {
   acceloTrigger->setOnYawRestCallback(onYawRestCallback);
   acceloTrigger->setOnYawThresholdCallback(onYawThresholdCallback);
   acceloTrigger->getYawOffset();
+  acceloTrigger->enableSensorOffload(sensorOffload);
+
+  // Hold both toes while powering on to calibrate the IMU thresholds for this user
+  if (digitalRead(btnPins[0]) == LOW && digitalRead(btnPins[1]) == LOW) {
+    acceloTrigger->startCalibration();
+  }
 
 
   delay(1000);
@@ -92,13 +144,105 @@ void setup() {
 void loop() {
   BLEDevice central = BLE.central();
 
-  monitor_battery_level();
+  monitor_battery();
+
+  // Type "calibrate" in the serial monitor to calibrate the IMU thresholds
+  if (debugMode && Serial.available()) {
+    String command = Serial.readStringUntil('\n');
+    command.trim();
+    if (command == "calibrate") acceloTrigger->startCalibration();
+    if (command == "stats") printNotifyStats();
+    if (command == "imu") acceloTrigger->printOffloadStats();
+    if (command == "pressure") printPressure();
+  }
 
   acceloTrigger->loop();
   systemActive = !acceloTrigger->getSleepState();
-  if (!systemActive) return;  // nothing to do if system is off
+  if (toePressureMode) updatePressureScan();
+  bool newPressure = fsrPressure.loop();
+  if (systemActive) {  // no new button presses if system is off
+    if (toePressureMode) {
+      if (newPressure) processPressure();
+    } else {
+      processButtons();
+    }
+  }
+
+  // Send whatever changed this loop in a single notification, and the next button edge once its turn comes
+  publishPayload();
+
+  // Nothing to read from the IMU until it raises INT1, let the MCU sleep
+  if (acceloTrigger->isOffloaded() && !payloadDirty && buttonEdgeCount == 0) delay(offloadIdleDelayMS);
+}
+
+/************************************************************************
+ * Notifications
+ *
+ * Buttons, pressure and IMU callbacks only change payloadData and mark it dirty. publishPayload() sends the
+ * merged latest state once per loop, as soon as something changed. The arm reads the characteristic over and
+ * over instead of subscribing, so holding updates back would only make them staler.
+ *
+ * The payload only has room for one button, so button edges queue up and take turns: each edge stays in the
+ * payload for edgeHoldMS before the next one replaces it, and an edge whose write failed is written again
+ * before any later one. A press and a release of both toes in the same loop reach the arm 30 ms apart.
+ */
+void markPayloadDirty() {
+  if (payloadDirty) notificationsCoalesced++;
+  payloadDirty = true;
+}
+
+bool queueButtonEdge(uint8_t button, uint8_t value) {
+  if (buttonEdgeCount == BUTTON_EDGE_QUEUE_SIZE) {
+    buttonEdgesDropped++;
+    return false;
+  }
+  int slot = (buttonEdgeHead + buttonEdgeCount) % BUTTON_EDGE_QUEUE_SIZE;
+  buttonEdges[slot].button = button;
+  buttonEdges[slot].value = value;
+  edgeQueuedMS[slot] = millis();
+  buttonEdgeCount++;
+  return true;
+}
+
+void publishPayload() {
+  bool edgeNext = buttonEdgeCount > 0 && millis() - lastEdgeMS >= edgeHoldMS;
+  if (edgeNext) {
+    payloadData.footButton = buttonEdges[buttonEdgeHead].button;
+    payloadData.buttonValue = buttonEdges[buttonEdgeHead].value;
+  }
+  if (!payloadDirty && !edgeNext) return;
+
+  if (!customCharacteristic.writeValue(reinterpret_cast<uint8_t*>(&payloadData), sizeof(payloadData))) {
+    // Stack is out of buffers, keep the payload dirty and the edge queued and try again next loop
+    notificationsFailed++;
+    return;
+  }
+
+  notificationsSent++;
+  payloadDirty = false;
+  if (!edgeNext) return;
 
-  processButtons();
+  lastEdgeMS = millis();
+  maxEdgeWaitMS = max(maxEdgeWaitMS, lastEdgeMS - edgeQueuedMS[buttonEdgeHead]);
+  buttonEdgeHead = (buttonEdgeHead + 1) % BUTTON_EDGE_QUEUE_SIZE;
+  buttonEdgeCount--;
+  buttonEdgesSent++;
+}
+
+void printNotifyStats() {
+  Serial.print("notifications sent: ");
+  Serial.print(notificationsSent);
+  Serial.print(" coalesced: ");
+  Serial.print(notificationsCoalesced);
+  Serial.print(" failed: ");
+  Serial.println(notificationsFailed);
+  Serial.print("button edges sent: ");
+  Serial.print(buttonEdgesSent);
+  Serial.print(" dropped: ");
+  Serial.print(buttonEdgesDropped);
+  Serial.print(" longest wait: ");
+  Serial.print(maxEdgeWaitMS);
+  Serial.println(" ms");
 }
 
 /************************************************************************
@@ -111,17 +255,14 @@ void processButtons() {
     if (prevBtnValues[i] == btnValues[i]) continue;  //if button is in same state as previously recorded, skip rest of function and restart
 
     // print for debugging
-    Serial.print("button ");
-    Serial.print(i);
-    Serial.print(": ");
-    Serial.println(!btnValues[i] ? "pressed" : "released");
-    Serial.println(!btnValues[i]);
-
-    payloadData.footButton = i;
-    payloadData.buttonValue = !btnValues[i];
-
-    customCharacteristic.writeValue(reinterpret_cast<uint8_t*>(&payloadData), sizeof(payloadData));
-
+    if (debugMode) {
+      Serial.print("button ");
+      Serial.print(i);
+      Serial.print(": ");
+      Serial.println(!btnValues[i] ? "pressed" : "released");
+    }
+
+    if (!queueButtonEdge(i, !btnValues[i])) continue;
     prevBtnValues[i] = btnValues[i];
   }
 
@@ -129,31 +270,99 @@ void processButtons() {
   //Serial.println(digitalRead(btnPins[1]));
 }
 
+/************************************************************************
+ * Toe Pressure
+ *
+ * The latest pressure goes out with the next notification. Changes smaller than
+ * pressureDeadband are left out, except for getting back to 0 so the arm always sees the toe let go.
+ */
+void processPressure() {
+  for (int toe = 0; toe < 2; toe++) {
+    uint8_t pressure = fsrPressure.getPressure(toe);
+    uint8_t sent = payloadData.toePressure[toe];
+    if (pressure == sent) continue;
+    if (abs(pressure - sent) < pressureDeadband && pressure != 0) continue;
+
+    payloadData.toePressure[toe] = pressure;
+    markPayloadDirty();
+  }
+}
+
+/**
+ * Walking sends no toe input, so the scan stops until the foot is still again. The toes go back to 0 so the arm
+ * lets go of a grip the walking interrupted.
+ */
+void updatePressureScan() {
+  if (systemActive == fsrPressure.isScanning()) return;
+  if (systemActive) {
+    fsrPressure.begin();
+    return;
+  }
+
+  fsrPressure.end();
+  payloadData.toePressure[0] = 0;
+  payloadData.toePressure[1] = 0;
+  markPayloadDirty();
+}
+
+void printPressure() {
+  Serial.print("pressure big toe: ");
+  Serial.print(fsrPressure.getPressure(0));
+  Serial.print(" four toes: ");
+  Serial.print(fsrPressure.getPressure(1));
+  Serial.print(" buffers: ");
+  Serial.print(fsrPressure.getBuffersRead());
+  Serial.print(" skipped: ");
+  Serial.print(fsrPressure.getBuffersSkipped());
+  Serial.print(" overwritten: ");
+  Serial.println(fsrPressure.getBuffersOverwritten());
+}
+
+/************************************************************************
+ * Battery
+ *
+ * In pressure mode the scan owns the ADC and the battery reading comes from it. While the scan is stopped
+ * for walking the last reading stands.
+ */
+void monitor_battery() {
+  static unsigned long lastBatteryMS = 0;
+
+  if (!toePressureMode) {
+    monitor_battery_level();
+    return;
+  }
+
+  if (!fsrPressure.isScanning() || millis() - lastBatteryMS < 1000) return;
+  lastBatteryMS = millis();
+  BatteryLevel = fsrPressure.getBatteryReading();
+  update_battery_level();
+}
+
 /************************************************************************
  * IMU 
  */
 ///NOTE: Change these transmit payload functions. Either change type or index
 void onPitchThresholdCallback(float offset) {
-  Serial.println("*** ROTATE WRIST");
+  if (debugMode) Serial.println("*** ROTATE WRIST");
   //Serial.println(offset);
   payloadData.pitchValue = offset;
-  customCharacteristic.writeValue(reinterpret_cast<uint8_t*>(&payloadData), sizeof(payloadData));
+  markPayloadDirty();
 }
 void onPitchRestCallback() {
-  Serial.println("*** STOP ROTATE WRIST");
+  if (debugMode) Serial.println("*** STOP ROTATE WRIST");
   //Serial.println("0");
   payloadData.pitchValue = 0;
-  customCharacteristic.writeValue(reinterpret_cast<uint8_t*>(&payloadData), sizeof(payloadData));
+  markPayloadDirty();
 }
 void onYawThresholdCallback(float offset) {
-  Serial.println("*** BEND WRIST");
+  if (debugMode) Serial.println("*** BEND WRIST");
   //Serial.println(offset);
   payloadData.yawValue = offset;
-  customCharacteristic.writeValue(reinterpret_cast<uint8_t*>(&payloadData), sizeof(payloadData));
+  markPayloadDirty();
 }
 void onYawRestCallback() {
-  Serial.println("*** STOP BEND WRIST");
+  if (debugMode) Serial.println("*** STOP BEND WRIST");
   //Serial.println("0");
   payloadData.yawValue = 0;
-  customCharacteristic.writeValue(reinterpret_cast<uint8_t*>(&payloadData), sizeof(payloadData));
+  markPayloadDirty();
 }
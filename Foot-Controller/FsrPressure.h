@@ -0,0 +1,238 @@
+/*****************************************************************************/
+//  FsrPressure
+//  Hardware:      Seeeduino Xiao nRF52840 Sense, force sensitive resistors
+//
+//  Description:
+//  Pressure mode for the toes. A force sensitive resistor sits at each toe
+//  position, wired from 3V3 to the analog pin with a 10k resistor to ground,
+//  so the voltage rises with pressure. Big toe on A0, small toes on A1.
+//
+//  The SAADC scans both toes and the battery divider (AIN7) continuously
+//  without the CPU: TIMER4 triggers a scan every FSR_SCAN_PERIOD_US through
+//  PPI and EasyDMA fills one of two buffers with FSR_SCANS_PER_BUFFER scans.
+//  When a buffer is full the SAADC restarts on the other one, also through
+//  PPI. The SAADC interrupt points RESULT.PTR at the next buffer as soon as a
+//  start has latched it, and marks the buffer that just ended as ready, so a
+//  loop() stalled by a delay or a BLE call never makes both restarts use the
+//  same buffer. loop() averages the latest ready buffer, smooths it and turns
+//  it into a pressure of 0 (resting) to 255 (fullPressureRaw) per toe. A
+//  buffer the SAADC came back to while loop() was averaging it is dropped.
+//
+//  While scanning, the SAADC belongs to this class. The battery reading comes
+//  from the scan (getBatteryReading()) instead of monitor_battery_level().
+//  end() stops the scan while the foot is walking and begin() picks it up
+//  again. The filters keep the rest reading they took at the first scan,
+//  since the toes may be loaded when the scan comes back.
+/*******************************************************************************/
+
+#include <nrf52840.h>
+#include <nrfx_ppi.h>
+
+#define FSR_CHANNELS 3             // big toe, small toes, battery
+#define FSR_BATTERY_CHANNEL 2
+#define FSR_SCANS_PER_BUFFER 16
+#define FSR_SCAN_PERIOD_US 1000
+
+/**
+ * Smooths the averaged readings of one toe and maps them to a pressure.
+ * Nothing in here touches the hardware.
+ */
+class PressureFilter {
+  private:
+    float smoothed = 0;
+    float restRaw = 0;
+    bool primed = false;
+
+  public:
+    float alpha = 0.3;             // weight of a new reading, lower is smoother and slower
+    float fullPressureRaw = 3000;  // reading for a full press
+
+    /**
+     * Add one averaged reading
+     * @returns pressure from 0 to 255
+     */
+    uint8_t add(float raw) {
+      if (!primed) {
+        // The toes are resting when the scan starts
+        smoothed = raw;
+        restRaw = raw;
+        primed = true;
+      }
+      smoothed = smoothed + alpha * (raw - smoothed);
+
+      float pressure = (smoothed - restRaw) / (fullPressureRaw - restRaw) * 255;
+      if (pressure < 0) return 0;
+      if (pressure > 255) return 255;
+      return (uint8_t)pressure;
+    }
+};
+
+class FsrPressure {
+  private:
+    nrf_saadc_value_t buffers[2][FSR_SCANS_PER_BUFFER * FSR_CHANNELS];
+    volatile int filling = -1;     // buffer the SAADC is writing into, -1 until it has started
+    volatile int ready = -1;       // buffer that ended last and was not read yet
+    volatile unsigned long buffersEnded = 0;
+    nrf_ppi_channel_t samplePpi;
+    nrf_ppi_channel_t restartPpi;
+    uint32_t previousIrqVector = 0;
+    bool scanning = false;
+
+    uint8_t pressure[2] = { 0, 0 };
+    nrf_saadc_value_t batteryReading = 0;
+    unsigned long buffersRead = 0;
+    unsigned long buffersSkipped = 0;    // ended and replaced by the next one before loop() got to them
+    unsigned long buffersOverwritten = 0;
+
+    static FsrPressure *active;
+
+    /**
+     * SAADC interrupt. Handles the end before the restart that follows it, the buffer that ended is the one
+     * the last start latched.
+     */
+    static void saadcIrq() {
+      FsrPressure *scan = active;
+      if (NRF_SAADC->EVENTS_END) {
+        NRF_SAADC->EVENTS_END = 0;
+        if (scan->filling >= 0) {
+          if (scan->ready >= 0) scan->buffersSkipped++;
+          scan->ready = scan->filling;
+          scan->buffersEnded++;
+        }
+      }
+
+      // A start latches RESULT.PTR, point the next restart at the other buffer
+      if (NRF_SAADC->EVENTS_STARTED) {
+        NRF_SAADC->EVENTS_STARTED = 0;
+        scan->filling = NRF_SAADC->RESULT.PTR == (uint32_t)scan->buffers[0] ? 0 : 1;
+        NRF_SAADC->RESULT.PTR = (uint32_t)scan->buffers[1 - scan->filling];
+      }
+    }
+
+    void configureChannel(int channel, uint32_t analogInput) {
+      NRF_SAADC->CH[channel].PSELP = analogInput;
+      NRF_SAADC->CH[channel].PSELN = SAADC_CH_PSELN_PSELN_NC;
+      // Same scale as mbed's AnalogIn so the battery math keeps working: gain 1/4 against VDD/4
+      NRF_SAADC->CH[channel].CONFIG = (SAADC_CH_CONFIG_GAIN_Gain1_4 << SAADC_CH_CONFIG_GAIN_Pos)
+                                      | (SAADC_CH_CONFIG_REFSEL_VDD1_4 << SAADC_CH_CONFIG_REFSEL_Pos)
+                                      | (SAADC_CH_CONFIG_TACQ_10us << SAADC_CH_CONFIG_TACQ_Pos)
+                                      | (SAADC_CH_CONFIG_MODE_SE << SAADC_CH_CONFIG_MODE_Pos);
+    }
+
+  public:
+    PressureFilter filters[2];
+
+    /**
+     * Take over the SAADC and start scanning. Call it after setupBatteryLevel().
+     */
+    void begin() {
+      // The mbed AnalogIn driver must not see our events, ours go to saadcIrq() until end()
+      NVIC_DisableIRQ(SAADC_IRQn);
+      NRF_SAADC->INTENCLR = 0xFFFFFFFF;
+      NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Disabled;
+      active = this;
+      previousIrqVector = NVIC_GetVector(SAADC_IRQn);
+      NVIC_SetVector(SAADC_IRQn, (uint32_t)&saadcIrq);
+
+      for (int channel = 0; channel < 8; channel++) NRF_SAADC->CH[channel].PSELP = SAADC_CH_PSELP_PSELP_NC;
+      configureChannel(0, SAADC_CH_PSELP_PSELP_AnalogInput0);  // A0, big toe
+      configureChannel(1, SAADC_CH_PSELP_PSELP_AnalogInput1);  // A1, small toes
+      configureChannel(FSR_BATTERY_CHANNEL, SAADC_CH_PSELP_PSELP_AnalogInput7);  // P0.31, battery divider
+      NRF_SAADC->RESOLUTION = SAADC_RESOLUTION_VAL_12bit;
+      NRF_SAADC->OVERSAMPLE = SAADC_OVERSAMPLE_OVERSAMPLE_Bypass;
+      NRF_SAADC->SAMPLERATE = SAADC_SAMPLERATE_MODE_Task << SAADC_SAMPLERATE_MODE_Pos;
+      NRF_SAADC->RESULT.MAXCNT = FSR_SCANS_PER_BUFFER * FSR_CHANNELS;
+      NRF_SAADC->RESULT.PTR = (uint32_t)buffers[0];
+      NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Enabled;
+
+      // Scan timer, 1 MHz
+      NRF_TIMER4->TASKS_STOP = 1;
+      NRF_TIMER4->MODE = TIMER_MODE_MODE_Timer;
+      NRF_TIMER4->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+      NRF_TIMER4->PRESCALER = 4;
+      NRF_TIMER4->CC[0] = FSR_SCAN_PERIOD_US;
+      NRF_TIMER4->SHORTS = TIMER_SHORTS_COMPARE0_CLEAR_Msk;
+
+      nrfx_ppi_channel_alloc(&samplePpi);
+      nrfx_ppi_channel_assign(samplePpi, (uint32_t)&NRF_TIMER4->EVENTS_COMPARE[0], (uint32_t)&NRF_SAADC->TASKS_SAMPLE);
+      nrfx_ppi_channel_alloc(&restartPpi);
+      nrfx_ppi_channel_assign(restartPpi, (uint32_t)&NRF_SAADC->EVENTS_END, (uint32_t)&NRF_SAADC->TASKS_START);
+      nrfx_ppi_channel_enable(samplePpi);
+      nrfx_ppi_channel_enable(restartPpi);
+
+      NRF_SAADC->EVENTS_STARTED = 0;
+      NRF_SAADC->EVENTS_END = 0;
+      filling = -1;
+      ready = -1;
+      NVIC_ClearPendingIRQ(SAADC_IRQn);
+      NRF_SAADC->INTENSET = SAADC_INTENSET_STARTED_Msk | SAADC_INTENSET_END_Msk;
+      NVIC_EnableIRQ(SAADC_IRQn);
+      NRF_SAADC->TASKS_START = 1;
+      NRF_TIMER4->TASKS_START = 1;
+      scanning = true;
+    }
+
+    /**
+     * Read the buffer the SAADC filled last. Should be called every loop, a late call only skips buffers.
+     * @returns true when a new pressure was worked out
+     */
+    bool loop() {
+      if (!scanning) return false;
+
+      NVIC_DisableIRQ(SAADC_IRQn);
+      int filledBuffer = ready;
+      ready = -1;
+      unsigned long ended = buffersEnded;
+      NVIC_EnableIRQ(SAADC_IRQn);
+      if (filledBuffer < 0) return false;
+
+      const nrf_saadc_value_t *samples = buffers[filledBuffer];
+      long sums[FSR_CHANNELS] = { 0, 0, 0 };
+      for (int scan = 0; scan < FSR_SCANS_PER_BUFFER; scan++) {
+        for (int channel = 0; channel < FSR_CHANNELS; channel++) {
+          sums[channel] += samples[scan * FSR_CHANNELS + channel];
+        }
+      }
+
+      // The other buffer ended meanwhile, so the SAADC is writing into this one again
+      if (buffersEnded != ended) {
+        buffersOverwritten++;
+        return false;
+      }
+
+      pressure[0] = filters[0].add((float)sums[0] / FSR_SCANS_PER_BUFFER);
+      pressure[1] = filters[1].add((float)sums[1] / FSR_SCANS_PER_BUFFER);
+      batteryReading = sums[FSR_BATTERY_CHANNEL] / FSR_SCANS_PER_BUFFER;
+      buffersRead++;
+      return true;
+    }
+
+    /**
+     * Stop scanning and switch the SAADC off until the next begin()
+     */
+    void end() {
+      if (!scanning) return;
+      NRF_TIMER4->TASKS_STOP = 1;
+      nrfx_ppi_channel_disable(samplePpi);
+      nrfx_ppi_channel_disable(restartPpi);
+      nrfx_ppi_channel_free(samplePpi);
+      nrfx_ppi_channel_free(restartPpi);
+      NRF_SAADC->EVENTS_STOPPED = 0;
+      NRF_SAADC->TASKS_STOP = 1;
+      while (!NRF_SAADC->EVENTS_STOPPED) {}
+      NVIC_DisableIRQ(SAADC_IRQn);
+      NRF_SAADC->INTENCLR = 0xFFFFFFFF;
+      NVIC_SetVector(SAADC_IRQn, previousIrqVector);
+      NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Disabled;
+      scanning = false;
+    }
+
+    bool isScanning() { return scanning; }
+    uint8_t getPressure(int toe) { return pressure[toe]; }
+    nrf_saadc_value_t getBatteryReading() { return batteryReading; }
+    unsigned long getBuffersRead() { return buffersRead; }
+    unsigned long getBuffersSkipped() { return buffersSkipped; }
+    unsigned long getBuffersOverwritten() { return buffersOverwritten; }
+};
+
+FsrPressure *FsrPressure::active = nullptr;
@@ -12,6 +12,23 @@
 //  enter sleep mode for two seconds until the device is no longer moving quickly.
 //  The rest position is reset whenever the device exits sleep mode.
 //
+//  Calibration:
+//  startCalibration() measures the rest noise for two seconds and then records
+//  deliberate tilts for five seconds. The pitch and yaw thresholds are set from
+//  the measured noise floor and tilt peaks (the rest thresholds give the
+//  hysteresis) and saved to flash, so they are loaded again on the next boot.
+//  The math lives in acceloCalibration.h so the host tests can replay it.
+//  While at rest the rest position slowly follows sensor drift.
+//
+//  Sensor offload:
+//  With enableSensorOffload(true) the IMU's embedded pedometer, significant
+//  motion and tilt functions run all the time, and steps keep the trigger in
+//  sleep mode while walking. After a few seconds at rest the IMU drops to
+//  26 Hz low power with the gyroscope off and raises INT1 on motion or tilt,
+//  so the MCU reads nothing until then. Motion without steps switches back to
+//  full rate sampling for the tilt gesture. printOffloadStats() reports the
+//  estimated IMU current and the wake up to first callback latency.
+//
 //  Available callbacks:
 //  - onPitchThresholdCallback,
 //  - onPitchRestCallback,
@@ -21,6 +38,66 @@
 
 #include "LSM6DS3.h"
 #include "Wire.h"
+#include "mbed.h"
+#include "FlashIAP.h"
+#include "acceloCalibration.h"
+
+// Last flash page below the bootloader, keeps the calibration across power cycles
+#define ACCELO_CALIBRATION_ADDRESS 0xF3000
+#define ACCELO_CALIBRATION_MAGIC 0x43414C31  // "CAL1"
+
+struct AcceloCalibration {
+  uint32_t magic;
+  float pitchOffsetThreshold;
+  float pitchRestThreshold;
+  float yawOffsetThreshold;
+  float yawRestThreshold;
+  float sleepGyroThreshold;
+  float noiseX, noiseY, noiseZ;  // standard deviation of the accelerometer at rest
+  uint32_t checksum;
+};
+
+// LSM6DS3TR-C registers and bits used by the sensor offload mode
+#define IMU_REG_INT1_CTRL 0x0D
+#define IMU_REG_CTRL1_XL 0x10
+#define IMU_REG_CTRL2_G 0x11
+#define IMU_REG_CTRL6_C 0x15
+#define IMU_REG_CTRL10_C 0x19
+#define IMU_REG_WAKE_UP_SRC 0x1B
+#define IMU_REG_STEP_COUNTER_L 0x4B
+#define IMU_REG_STEP_COUNTER_H 0x4C
+#define IMU_REG_FUNC_SRC1 0x53
+#define IMU_REG_TAP_CFG 0x58
+#define IMU_REG_WAKE_UP_THS 0x5B
+#define IMU_REG_WAKE_UP_DUR 0x5C
+#define IMU_REG_MD1_CFG 0x5E
+
+#define IMU_CTRL1_XL_26HZ_2G 0x20
+#define IMU_CTRL6_XL_HM_MODE 0x10   // high performance off
+#define IMU_CTRL10_PEDO_EN 0x10
+#define IMU_CTRL10_TILT_EN 0x08
+#define IMU_CTRL10_FUNC_EN 0x04
+#define IMU_CTRL10_SIGN_MOTION_EN 0x01
+#define IMU_TAP_CFG_INTERRUPTS_ENABLE 0x80
+#define IMU_TAP_CFG_SLOPE_FDS 0x10  // wake up on high pass filtered data, so a slow tilt still counts
+#define IMU_TAP_CFG_LIR 0x01        // latch interrupts until the source register is read
+#define IMU_MD1_INT1_WU 0x20
+#define IMU_MD1_INT1_TILT 0x02
+#define IMU_INT1_SIGN_MOT 0x40
+#define IMU_FUNC_SRC1_SIGN_MOTION_IA 0x40
+
+// IMU INT1 on the Xiao nRF52840 Sense
+#ifndef ACCELO_INT1_PIN
+#define ACCELO_INT1_PIN P0_11
+#endif
+
+volatile bool acceloInterruptPending = false;
+volatile unsigned long acceloInterruptUS = 0;
+
+void onAcceloInterrupt() {
+  acceloInterruptUS = micros();
+  acceloInterruptPending = true;
+}
 
 class SeeedAcceloTrigger {
   private:
@@ -28,12 +105,12 @@ class SeeedAcceloTrigger {
     float restX, restY, restZ;
     float offsetX, offsetY, offsetZ;
     
-    float pitchOffsetThreshold = 0.32;
-    float pitchRestThreshold = 0.15;
+    float pitchOffsetThreshold = acceloDefaultThresholds.pitchOffset;
+    float pitchRestThreshold = acceloDefaultThresholds.pitchRest;
     bool pitchTresholdCrossed = false;
 
-    float yawOffsetThreshold = 0.18;
-    float yawRestThreshold = 0.15;
+    float yawOffsetThreshold = acceloDefaultThresholds.yawOffset;
+    float yawRestThreshold = acceloDefaultThresholds.yawRest;
     bool yawTresholdCrossed = false;
 
     typedef void (*threshold_callback_t)(float offset); // Define the callback function pointer type
@@ -50,7 +127,324 @@ class SeeedAcceloTrigger {
     unsigned long sleepLength = 30; //Time before it wakes up
     
     //The measurement to when it defines that someone is walking (AKA goes to sleep)
-    float sleepGyroThreshold = 50;
+    float sleepGyroThreshold = acceloDefaultThresholds.sleepGyro;
+
+    // Calibration
+    enum CalibrationState { CALIBRATION_OFF, CALIBRATION_REST, CALIBRATION_TILT };
+    CalibrationState calibrationState = CALIBRATION_OFF;
+    unsigned long calibrationStart;
+    unsigned long calibrationRestLength = 2000;
+    unsigned long calibrationTiltLength = 5000;
+    unsigned long restSamples;
+    float restMean[3], restM2[3];  // running mean and squared deviation of x, y, z at rest
+    float noiseX = 0, noiseY = 0, noiseZ = 0;
+    AcceloTiltPeaks tiltPeaks;
+
+    unsigned long lastDriftMS = 0;
+
+    /*
+     * Collect the rest noise statistics, then the deliberate tilt peaks
+     */
+    void calibrationLoop() {
+      float sample[3] = { imu.readFloatAccelX(), imu.readFloatAccelY(), imu.readFloatAccelZ() };
+
+      if (calibrationState == CALIBRATION_REST) {
+        restSamples++;
+        for (int i = 0; i < 3; i++) {
+          float delta = sample[i] - restMean[i];
+          restMean[i] += delta / restSamples;
+          restM2[i] += delta * (sample[i] - restMean[i]);
+        }
+
+        if (millis() - calibrationStart < calibrationRestLength) return;
+
+        restX = restMean[0];
+        restY = restMean[1];
+        restZ = restMean[2];
+        noiseX = sqrt(restM2[0] / restSamples);
+        noiseY = sqrt(restM2[1] / restSamples);
+        noiseZ = sqrt(restM2[2] / restSamples);
+        tiltPeaks = AcceloTiltPeaks();
+        calibrationState = CALIBRATION_TILT;
+        calibrationStart = millis();
+        Serial.println("Calibration: tilt your foot forward, back, left and right");
+        return;
+      }
+
+      offsetX = sample[0] - restX;
+      offsetY = sample[1] - restY;
+      offsetZ = sample[2] - restZ;
+      tiltPeaks.add(getPitchOffset(), getYawOffset(), max(abs(imu.readFloatGyroX()), max(abs(imu.readFloatGyroY()), abs(imu.readFloatGyroZ()))));
+
+      if (millis() - calibrationStart < calibrationTiltLength) return;
+
+      finishCalibration();
+    }
+
+    /*
+     * Turn the measured statistics into thresholds, see acceloCalibrate()
+     */
+    void finishCalibration() {
+      calibrationState = CALIBRATION_OFF;
+      offsetX = offsetY = offsetZ = 0;
+
+      AcceloThresholds current = { pitchOffsetThreshold, pitchRestThreshold, yawOffsetThreshold, yawRestThreshold, sleepGyroThreshold };
+      AcceloThresholds calibrated = acceloCalibrate(getPitchAxis(noiseX, noiseY, noiseZ), getYawAxis(noiseX, noiseY, noiseZ), tiltPeaks, current);
+      pitchOffsetThreshold = calibrated.pitchOffset;
+      pitchRestThreshold = calibrated.pitchRest;
+      yawOffsetThreshold = calibrated.yawOffset;
+      yawRestThreshold = calibrated.yawRest;
+      sleepGyroThreshold = calibrated.sleepGyro;
+
+      Serial.print("Calibration done, pitch: ");
+      Serial.print(pitchOffsetThreshold);
+      Serial.print("/");
+      Serial.print(pitchRestThreshold);
+      Serial.print(" yaw: ");
+      Serial.print(yawOffsetThreshold);
+      Serial.print("/");
+      Serial.print(yawRestThreshold);
+      Serial.print(" sleep gyro: ");
+      Serial.println(sleepGyroThreshold);
+
+      saveCalibration();
+    }
+
+    uint32_t calibrationChecksum(const AcceloCalibration &calibration) {
+      const uint32_t *words = reinterpret_cast<const uint32_t *>(&calibration);
+      uint32_t checksum = 0;
+      for (size_t i = 0; i < offsetof(AcceloCalibration, checksum) / sizeof(uint32_t); i++) {
+        checksum = (checksum << 5 | checksum >> 27) ^ words[i];
+      }
+      return checksum;
+    }
+
+    void saveCalibration() {
+      AcceloCalibration calibration;
+      calibration.magic = ACCELO_CALIBRATION_MAGIC;
+      calibration.pitchOffsetThreshold = pitchOffsetThreshold;
+      calibration.pitchRestThreshold = pitchRestThreshold;
+      calibration.yawOffsetThreshold = yawOffsetThreshold;
+      calibration.yawRestThreshold = yawRestThreshold;
+      calibration.sleepGyroThreshold = sleepGyroThreshold;
+      calibration.noiseX = noiseX;
+      calibration.noiseY = noiseY;
+      calibration.noiseZ = noiseZ;
+      calibration.checksum = calibrationChecksum(calibration);
+
+      mbed::FlashIAP flash;
+      flash.init();
+      flash.erase(ACCELO_CALIBRATION_ADDRESS, flash.get_sector_size(ACCELO_CALIBRATION_ADDRESS));
+      flash.program(&calibration, ACCELO_CALIBRATION_ADDRESS, sizeof(calibration));
+      flash.deinit();
+    }
+
+    bool loadCalibration() {
+      AcceloCalibration calibration;
+      mbed::FlashIAP flash;
+      flash.init();
+      flash.read(&calibration, ACCELO_CALIBRATION_ADDRESS, sizeof(calibration));
+      flash.deinit();
+
+      if (calibration.magic != ACCELO_CALIBRATION_MAGIC || calibration.checksum != calibrationChecksum(calibration)) return false;
+
+      pitchOffsetThreshold = calibration.pitchOffsetThreshold;
+      pitchRestThreshold = calibration.pitchRestThreshold;
+      yawOffsetThreshold = calibration.yawOffsetThreshold;
+      yawRestThreshold = calibration.yawRestThreshold;
+      sleepGyroThreshold = acceloClampSleepGyro(calibration.sleepGyroThreshold);  // older calibrations could grow it without limit
+      noiseX = calibration.noiseX;
+      noiseY = calibration.noiseY;
+      noiseZ = calibration.noiseZ;
+      return true;
+    }
+
+    /*
+     * Let the rest position follow slow drift while the foot is clearly at rest, by the time since the last pass
+     */
+    void trackRestDrift() {
+      unsigned long now = millis();
+      unsigned long elapsedMS = now - lastDriftMS;
+      lastDriftMS = now;
+      if (pitchTresholdCrossed || yawTresholdCrossed) return;
+
+      float pitchOffset = getPitchOffset();
+      float yawOffset = getYawOffset();
+      acceloTrackDrift(restX, offsetX, pitchOffset, yawOffset, pitchRestThreshold, yawRestThreshold, elapsedMS);
+      acceloTrackDrift(restY, offsetY, pitchOffset, yawOffset, pitchRestThreshold, yawRestThreshold, elapsedMS);
+      acceloTrackDrift(restZ, offsetZ, pitchOffset, yawOffset, pitchRestThreshold, yawRestThreshold, elapsedMS);
+    }
+
+    /*
+     * Pick the pitch or yaw component of a per axis value, the same way getPitchOffset and getYawOffset do
+     */
+    float getPitchAxis (float x, float y, float z) {
+      char upAxis = getUpAxis();
+      if (upAxis == 'x') return z;
+      if (upAxis == 'y') return x;
+      return y;
+    }
+
+    float getYawAxis (float x, float y, float z) {
+      char upAxis = getUpAxis();
+      if (upAxis == 'x') return y;
+      if (upAxis == 'y') return z;
+      return x;
+    }
+
+    // Sensor offload
+    mbed::InterruptIn imuInterrupt;
+    bool offloadEnabled = false;
+    bool offloaded = false;
+    uint8_t fullRateCtrl1XL, fullRateCtrl2G, fullRateCtrl6C;  // restored when leaving low power
+    uint16_t lastStepCount = 0;
+    bool stepSeen = false;
+    unsigned long lastStepMS = 0;
+    unsigned long lastStepPoll = 0;
+    unsigned long lastActivityMS = 0;
+    unsigned long stepPollInterval = 100;
+    unsigned long walkingHoldLength = 2000;  // wrist commands stay off this long after the last step
+    unsigned long idleBeforeOffload = 3000;  // time at rest before the IMU takes over motion detection
+    float wakeUpThreshold = 0.1;             // g of high pass filtered motion that raises INT1
+
+    // Offload stats, currents are datasheet figures for the LSM6DS3TR-C
+    float fullRateCurrentMA = 1.25;  // accelerometer and gyroscope in high performance mode
+    float offloadCurrentMA = 0.03;   // accelerometer at 26 Hz low power with the embedded functions
+    unsigned long fullRateMS = 0;
+    unsigned long offloadedMS = 0;
+    unsigned long modeStartMS = 0;
+    unsigned long offloadWakeUps = 0;
+    bool awaitingFirstCallback = false;
+    unsigned long wakeUS = 0;
+    unsigned long wakeToCallbackUS = 0;
+    unsigned long maxWakeToCallbackUS = 0;
+
+    uint8_t readImuRegister(uint8_t reg) {
+      uint8_t value = 0;
+      imu.readRegister(&value, reg);
+      return value;
+    }
+
+    /*
+     * Start the pedometer, significant motion and tilt detection inside the IMU. They keep running in both modes.
+     */
+    void setupEmbeddedFunctions() {
+      imu.writeRegister(IMU_REG_CTRL10_C, readImuRegister(IMU_REG_CTRL10_C) | IMU_CTRL10_FUNC_EN | IMU_CTRL10_PEDO_EN | IMU_CTRL10_TILT_EN | IMU_CTRL10_SIGN_MOTION_EN);
+      imu.writeRegister(IMU_REG_TAP_CFG, IMU_TAP_CFG_INTERRUPTS_ENABLE | IMU_TAP_CFG_SLOPE_FDS | IMU_TAP_CFG_LIR);
+      imu.writeRegister(IMU_REG_WAKE_UP_DUR, 0x00);
+      lastStepCount = readImuRegister(IMU_REG_STEP_COUNTER_L) | readImuRegister(IMU_REG_STEP_COUNTER_H) << 8;
+      imuInterrupt.rise(onAcceloInterrupt);
+    }
+
+    /*
+     * Check the IMU step counter for new steps
+     */
+    void pollSteps() {
+      lastStepPoll = millis();
+      uint16_t steps = readImuRegister(IMU_REG_STEP_COUNTER_L) | readImuRegister(IMU_REG_STEP_COUNTER_H) << 8;
+      if (steps != lastStepCount) {
+        stepSeen = true;
+        lastStepMS = millis();
+      }
+      lastStepCount = steps;
+    }
+
+    bool isWalking() { return stepSeen && millis() - lastStepMS < walkingHoldLength; }
+
+    void countModeTime() {
+      unsigned long now = millis();
+      if (offloaded) offloadedMS += now - modeStartMS;
+      else fullRateMS += now - modeStartMS;
+      modeStartMS = now;
+    }
+
+    /*
+     * Hand motion detection to the IMU: accelerometer at 26 Hz low power, gyroscope off, INT1 on motion or tilt
+     */
+    void enterOffload() {
+      countModeTime();
+      fullRateCtrl1XL = readImuRegister(IMU_REG_CTRL1_XL);
+      fullRateCtrl2G = readImuRegister(IMU_REG_CTRL2_G);
+      fullRateCtrl6C = readImuRegister(IMU_REG_CTRL6_C);
+
+      imu.writeRegister(IMU_REG_CTRL2_G, 0x00);
+      imu.writeRegister(IMU_REG_CTRL6_C, fullRateCtrl6C | IMU_CTRL6_XL_HM_MODE);
+      imu.writeRegister(IMU_REG_CTRL1_XL, IMU_CTRL1_XL_26HZ_2G);
+      imu.writeRegister(IMU_REG_WAKE_UP_THS, constrain((int)(wakeUpThreshold / (2.0 / 64) + 0.5), 1, 63));  // 1 LSB = 2 g / 64
+      imu.writeRegister(IMU_REG_MD1_CFG, IMU_MD1_INT1_WU | IMU_MD1_INT1_TILT);
+      imu.writeRegister(IMU_REG_INT1_CTRL, IMU_INT1_SIGN_MOT);
+
+      // Clear anything that latched while switching
+      readImuRegister(IMU_REG_WAKE_UP_SRC);
+      readImuRegister(IMU_REG_FUNC_SRC1);
+      acceloInterruptPending = false;
+      offloaded = true;
+    }
+
+    /*
+     * Back to the sample rate and range the LSM6DS3 library was set up with
+     */
+    void exitOffload() {
+      countModeTime();
+      imu.writeRegister(IMU_REG_MD1_CFG, 0x00);
+      imu.writeRegister(IMU_REG_INT1_CTRL, 0x00);
+      imu.writeRegister(IMU_REG_CTRL1_XL, fullRateCtrl1XL);
+      imu.writeRegister(IMU_REG_CTRL6_C, fullRateCtrl6C);
+      imu.writeRegister(IMU_REG_CTRL2_G, fullRateCtrl2G);
+      delay(5);  // a couple of samples at the full rate before reading again
+      offloaded = false;
+      lastActivityMS = millis();
+    }
+
+    /*
+     * Runs instead of the normal loop while offloaded. Nothing is read from the IMU unless INT1 fired
+     * or the trigger is waiting for walking to stop.
+     */
+    void offloadLoop() {
+      if (sleep && millis() - lastStepPoll >= stepPollInterval) {
+        pollSteps();
+        if (!isWalking()) {
+          exitOffload();
+          Serial.println("waking up...");
+          sleep = false;
+          setRestOrientation();
+          return;
+        }
+      }
+
+      if (!acceloInterruptPending) return;
+      acceloInterruptPending = false;
+      offloadWakeUps++;
+
+      readImuRegister(IMU_REG_WAKE_UP_SRC);
+      uint8_t functionSource = readImuRegister(IMU_REG_FUNC_SRC1);
+      pollSteps();
+
+      if (functionSource & IMU_FUNC_SRC1_SIGN_MOTION_IA) {
+        stepSeen = true;
+        lastStepMS = millis();
+      }
+
+      // Walking, stay in low power with wrist commands off
+      if (isWalking()) {
+        sleep = true;
+        sleepStart = millis();
+        return;
+      }
+
+      // Motion without steps, most likely the start of a tilt gesture
+      exitOffload();
+      if (sleep) return;
+      wakeUS = acceloInterruptUS;
+      awaitingFirstCallback = true;
+    }
+
+    void recordFirstCallback() {
+      if (!awaitingFirstCallback) return;
+      awaitingFirstCallback = false;
+      wakeToCallbackUS = micros() - wakeUS;
+      if (wakeToCallbackUS > maxWakeToCallbackUS) maxWakeToCallbackUS = wakeToCallbackUS;
+    }
 
     /*
      * Start sleeping if user is moving too fast; Wake up if enough time has passed
@@ -83,7 +477,7 @@ class SeeedAcceloTrigger {
     }
 
   public:
-    SeeedAcceloTrigger() : imu(I2C_MODE, 0x6A) {
+    SeeedAcceloTrigger() : imu(I2C_MODE, 0x6A), imuInterrupt(ACCELO_INT1_PIN) {
       if (imu.begin() != 0) {
         Serial.println("Device error");
       } else {
@@ -92,36 +486,130 @@ class SeeedAcceloTrigger {
 
       delay(500);
       setRestOrientation();
+
+      if (loadCalibration()) {
+        Serial.println("Calibration loaded");
+      }
+
+      setupEmbeddedFunctions();
+      modeStartMS = millis();
     }
 
     /*
     * Should be called in your code's loop function
     */
     void loop() {
+      if (calibrationState != CALIBRATION_OFF) {
+        calibrationLoop();
+        return;
+      }
+
+      if (offloaded) {
+        offloadLoop();
+        return;
+      }
+
+      // Steps counted by the IMU keep wrist commands off while walking
+      if (offloadEnabled) {
+        if (millis() - lastStepPoll >= stepPollInterval) pollSteps();
+        if (isWalking()) {
+          sleep = true;
+          sleepStart = millis();
+        }
+      }
+
       checkSleepConditions();
-      if (sleep) return;
+      if (sleep) {
+        if (offloadEnabled) enterOffload();
+        return;
+      }
 
       offsetX = imu.readFloatAccelX() - restX;
       offsetY = imu.readFloatAccelY() - restY;
       offsetZ = imu.readFloatAccelZ() - restZ;
+      trackRestDrift();
 
       // handle callbacks
       float pitchOffset = getPitchOffset();
-      if (abs(pitchOffset) < pitchRestThreshold && pitchTresholdCrossed && onPitchRestCallback) { onPitchRestCallback(); pitchTresholdCrossed = false; }
-      if (abs(pitchOffset) > pitchOffsetThreshold && !pitchTresholdCrossed && onPitchThresholdCallback) { onPitchThresholdCallback(pitchOffset); pitchTresholdCrossed = true; }
+      AcceloAxisEvent pitchEvent = acceloAxisUpdate(pitchOffset, pitchOffsetThreshold, pitchRestThreshold, pitchTresholdCrossed);
+      if (pitchEvent == ACCELO_AXIS_REST && onPitchRestCallback) onPitchRestCallback();
+      if (pitchEvent == ACCELO_AXIS_THRESHOLD && onPitchThresholdCallback) onPitchThresholdCallback(pitchOffset);
 
       float yawOffset = getYawOffset();
-      if (abs(yawOffset) < yawRestThreshold && yawTresholdCrossed  && onYawRestCallback) { onYawRestCallback(); yawTresholdCrossed = false; }
-      if (abs(yawOffset) > yawOffsetThreshold && !yawTresholdCrossed  && onYawThresholdCallback) { onYawThresholdCallback(yawOffset); yawTresholdCrossed = true; }
+      AcceloAxisEvent yawEvent = acceloAxisUpdate(yawOffset, yawOffsetThreshold, yawRestThreshold, yawTresholdCrossed);
+      if (yawEvent == ACCELO_AXIS_REST && onYawRestCallback) onYawRestCallback();
+      if (yawEvent == ACCELO_AXIS_THRESHOLD && onYawThresholdCallback) onYawThresholdCallback(yawOffset);
+
+      if (!offloadEnabled) return;
+      if (pitchTresholdCrossed || yawTresholdCrossed) recordFirstCallback();
+
+      // Hand motion detection back to the IMU once the foot has been still for a while
+      if (pitchTresholdCrossed || yawTresholdCrossed || abs(pitchOffset) > pitchRestThreshold / 2 || abs(yawOffset) > yawRestThreshold / 2) {
+        lastActivityMS = millis();
+      } else if (millis() - lastActivityMS > idleBeforeOffload) {
+        awaitingFirstCallback = false;
+        enterOffload();
+      }
     }
 
     /*
-    * Use the current orientation of the device as the new rest position   
+    * Use the current orientation of the device as the new rest position, averaged over a few samples
     */
     void setRestOrientation() {
-      restX = imu.readFloatAccelX();
-      restY = imu.readFloatAccelY();
-      restZ = imu.readFloatAccelZ();
+      const int samples = 16;
+      restX = restY = restZ = 0;
+      for (int i = 0; i < samples; i++) {
+        restX += imu.readFloatAccelX() / samples;
+        restY += imu.readFloatAccelY() / samples;
+        restZ += imu.readFloatAccelZ() / samples;
+      }
+    }
+
+    /*
+    * Start measuring the rest noise and the user's deliberate tilts. Keep the foot still until told to tilt.
+    * The trigger callbacks are not called while calibrating.
+    */
+    void startCalibration() {
+      if (offloaded) exitOffload();
+      Serial.println("Calibration: keep your foot still");
+      restSamples = 0;
+      for (int i = 0; i < 3; i++) {
+        restMean[i] = 0;
+        restM2[i] = 0;
+      }
+      sleep = false;
+      pitchTresholdCrossed = false;
+      yawTresholdCrossed = false;
+      calibrationState = CALIBRATION_REST;
+      calibrationStart = millis();
+    }
+
+    bool isCalibrating () { return calibrationState != CALIBRATION_OFF; }
+
+    /*
+    * Let the IMU's embedded functions watch for walking and motion so the MCU can sleep while the foot is still
+    */
+    void enableSensorOffload(bool enable) {
+      if (!enable && offloaded) exitOffload();
+      offloadEnabled = enable;
+      lastActivityMS = millis();
+    }
+
+    bool isOffloaded () { return offloaded; }
+
+    void printOffloadStats() {
+      countModeTime();
+      float totalMS = max(1.0f, (float)(fullRateMS + offloadedMS));
+      Serial.print("imu offloaded: ");
+      Serial.print(100.0 * offloadedMS / totalMS);
+      Serial.print("% avg current: ");
+      Serial.print((fullRateCurrentMA * fullRateMS + offloadCurrentMA * offloadedMS) / totalMS, 3);
+      Serial.print(" mA wake ups: ");
+      Serial.print(offloadWakeUps);
+      Serial.print(" wake to callback us (last/max): ");
+      Serial.print(wakeToCallbackUS);
+      Serial.print("/");
+      Serial.println(maxWakeToCallbackUS);
     }
 
     /*
@@ -165,6 +653,15 @@ class SeeedAcceloTrigger {
     void setPitchRestThreshold (float threshold) { pitchRestThreshold = threshold; }
     void setYawRestThreshold (float threshold) { yawRestThreshold = threshold; }
 
+    // CALIBRATION GETTERS
+    float getPitchOffsetThreshold () { return pitchOffsetThreshold; }
+    float getPitchRestThreshold () { return pitchRestThreshold; }
+    float getYawOffsetThreshold () { return yawOffsetThreshold; }
+    float getYawRestThreshold () { return yawRestThreshold; }
+    float getNoiseX () { return noiseX; }
+    float getNoiseY () { return noiseY; }
+    float getNoiseZ () { return noiseZ; }
+
     // SLEEP STATE GETTER
     bool getSleepState () { return sleep; }
     
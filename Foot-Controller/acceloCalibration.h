@@ -0,0 +1,145 @@
+/*****************************************************************************/
+//  AcceloCalibration
+//
+//  Description:
+//  The threshold math of SeeedAcceloTrigger without the IMU, so the host
+//  tests can replay tilt traces through exactly what the Foot Controller
+//  runs (see tests/acceloCalibrationTest.cpp).
+//
+//  While the user tilts, each sample only counts towards the peak of the
+//  axis that moves the most in it. The other axis leaks a fraction of every
+//  tilt, and that leakage would otherwise look like a small deliberate tilt
+//  and give that axis a hair trigger. The largest leakage seen is kept too:
+//  a threshold stays leakageMargin above it, so tilting one axis does not
+//  set off the other, and an axis whose peak is not well above its leakage
+//  keeps its thresholds. So does an axis tilted less than minTilt.
+//
+//  The walking gyro threshold comes from this calibration alone and stays
+//  between sleepGyroMin and sleepGyroMax, so repeated calibrations cannot
+//  ratchet it up until walking is never detected.
+//
+//  While the foot is at rest the rest position follows sensor drift with a
+//  time constant of restDriftTauS seconds, scaled by the time between loop
+//  passes so it is the same at any loop rate. Drift takes minutes, a slow
+//  deliberate tilt takes seconds and still reaches its threshold.
+/*******************************************************************************/
+
+#include <math.h>
+
+struct AcceloThresholds {
+  float pitchOffset;
+  float pitchRest;
+  float yawOffset;
+  float yawRest;
+  float sleepGyro;
+};
+
+// The thresholds the trigger used before it was calibrated
+const AcceloThresholds acceloDefaultThresholds = { 0.32, 0.15, 0.18, 0.15, 50 };
+
+struct AcceloCalibrationSettings {
+  float noiseThresholdFactor;   // offset threshold is at least this many standard deviations of the rest noise
+  float tiltThresholdFraction;  // and this fraction of the deliberate tilt
+  float restThresholdFraction;  // rest threshold as a fraction of the offset threshold, the hysteresis
+  float minTilt;                // g, an axis tilted less than this keeps its thresholds
+  float leakageMargin;          // offset threshold is at least this multiple of the leakage from the other axis
+  float sleepGyroMargin;        // walking gyro threshold as a multiple of the deliberate tilt gyro peak
+  float sleepGyroMin;           // dps
+  float sleepGyroMax;           // dps
+};
+
+const AcceloCalibrationSettings acceloCalibrationSettings = { 6, 0.4, 0.5, 0.12, 1.5, 1.5, 50, 200 };
+
+/**
+ * Peaks of the deliberate tilts, fed one sample at a time
+ */
+struct AcceloTiltPeaks {
+  float pitch = 0;
+  float yaw = 0;
+  float pitchLeakage = 0;  // largest pitch offset while yaw was tilted
+  float yawLeakage = 0;    // largest yaw offset while pitch was tilted
+  float gyro = 0;
+
+  void add(float pitchOffset, float yawOffset, float gyroMagnitude) {
+    pitchOffset = fabsf(pitchOffset);
+    yawOffset = fabsf(yawOffset);
+    if (pitchOffset > yawOffset) {
+      pitch = fmaxf(pitch, pitchOffset);
+      yawLeakage = fmaxf(yawLeakage, yawOffset);
+    } else {
+      yaw = fmaxf(yaw, yawOffset);
+      pitchLeakage = fmaxf(pitchLeakage, pitchOffset);
+    }
+    gyro = fmaxf(gyro, gyroMagnitude);
+  }
+};
+
+inline float acceloClampSleepGyro(float threshold, const AcceloCalibrationSettings &settings = acceloCalibrationSettings) {
+  return fminf(fmaxf(threshold, settings.sleepGyroMin), settings.sleepGyroMax);
+}
+
+/**
+ * Turn the rest noise and tilt peaks into thresholds. An axis that was not tilted clearly keeps its thresholds from current.
+ * @param pitchNoise, yawNoise standard deviation of each axis at rest
+ */
+inline AcceloThresholds acceloCalibrate(float pitchNoise, float yawNoise, const AcceloTiltPeaks &peaks, const AcceloThresholds &current,
+                                        const AcceloCalibrationSettings &settings = acceloCalibrationSettings) {
+  AcceloThresholds thresholds = current;
+
+  float pitchFloor = settings.noiseThresholdFactor * pitchNoise;
+  if (peaks.pitch > settings.minTilt && peaks.pitch > 2 * pitchFloor && peaks.pitch > 2 * peaks.pitchLeakage) {
+    thresholds.pitchOffset = fmaxf(fmaxf(pitchFloor, settings.leakageMargin * peaks.pitchLeakage), settings.tiltThresholdFraction * peaks.pitch);
+    thresholds.pitchRest = fmaxf(pitchFloor / 2, settings.restThresholdFraction * thresholds.pitchOffset);
+  }
+
+  float yawFloor = settings.noiseThresholdFactor * yawNoise;
+  if (peaks.yaw > settings.minTilt && peaks.yaw > 2 * yawFloor && peaks.yaw > 2 * peaks.yawLeakage) {
+    thresholds.yawOffset = fmaxf(fmaxf(yawFloor, settings.leakageMargin * peaks.yawLeakage), settings.tiltThresholdFraction * peaks.yaw);
+    thresholds.yawRest = fmaxf(yawFloor / 2, settings.restThresholdFraction * thresholds.yawOffset);
+  }
+
+  // Deliberate tilts must not look like walking
+  thresholds.sleepGyro = acceloClampSleepGyro(settings.sleepGyroMargin * peaks.gyro, settings);
+  return thresholds;
+}
+
+struct AcceloDriftSettings {
+  float restDriftTauS;       // s, time constant of the rest position following drift
+  unsigned long maxStepMS;   // longer gaps between loop passes, e.g. after sleep, count as this long
+};
+
+const AcceloDriftSettings acceloDriftSettings = { 30, 1000 };
+
+/**
+ * Fraction of the offset the rest position takes up after elapsedMS at rest
+ */
+inline float acceloDriftStep(unsigned long elapsedMS, const AcceloDriftSettings &settings = acceloDriftSettings) {
+  if (elapsedMS > settings.maxStepMS) elapsedMS = settings.maxStepMS;
+  return 1 - expf(-(elapsedMS / 1000.0f) / settings.restDriftTauS);
+}
+
+/**
+ * Let one rest value follow drift, only while both offsets are clearly within their rest thresholds
+ */
+inline void acceloTrackDrift(float &rest, float offset, float pitchOffset, float yawOffset, float pitchRestThreshold, float yawRestThreshold,
+                             unsigned long elapsedMS, const AcceloDriftSettings &settings = acceloDriftSettings) {
+  if (fabsf(pitchOffset) > pitchRestThreshold / 2 || fabsf(yawOffset) > yawRestThreshold / 2) return;
+  rest += acceloDriftStep(elapsedMS, settings) * offset;
+}
+
+enum AcceloAxisEvent { ACCELO_AXIS_NONE, ACCELO_AXIS_THRESHOLD, ACCELO_AXIS_REST };
+
+/**
+ * Hysteresis of one axis: the threshold event once the offset passes offsetThreshold, the rest event once it is back under restThreshold
+ */
+inline AcceloAxisEvent acceloAxisUpdate(float offset, float offsetThreshold, float restThreshold, bool &crossed) {
+  if (fabsf(offset) < restThreshold && crossed) {
+    crossed = false;
+    return ACCELO_AXIS_REST;
+  }
+  if (fabsf(offset) > offsetThreshold && !crossed) {
+    crossed = true;
+    return ACCELO_AXIS_THRESHOLD;
+  }
+  return ACCELO_AXIS_NONE;
+}
@@ -1,12 +1,29 @@
 #include <esp_now.h>
 #include <WiFi.h>
+#include <esp_wifi.h>
 #include "driver/rtc_io.h"
+#include "FsrPressure.h"
 
 #define BUTTON_PIN_BITMASK 0x30  // GPIOs 4 and 5
 #define LED_BUILTIN 15
 
 RTC_DATA_ATTR int bootCount = 0;
 
+// The arm pins its soft AP and ESP-NOW to this channel, keep it the same as RADIO_CHANNEL in Arm_Code/radioCoexistence.h
+#define ARM_RADIO_CHANNEL 6
+#define MAX_RADIO_CHANNEL 13
+#define CHANNEL_SEARCH_FAILURES 3  // undelivered messages in a row before looking for the arm on the next channel
+
+// Channel the arm was last found on, kept through deep sleep
+RTC_DATA_ATTR uint8_t armChannel = ARM_RADIO_CHANNEL;
+volatile int sendFailures = 0;
+int channelsSearched = 0;  // channels tried since the last delivered message, 0 when not searching
+
+// Time from esp_now_send() to the arm's acknowledgement
+unsigned long sendStartUS = 0;
+volatile unsigned long ackLatencyUS = 0;
+volatile unsigned long maxAckLatencyUS = 0;
+
 int timeElapsed = 0;
 int timeStartStopwatch = 0;
 int timeEndStopwatch = 0;
@@ -21,10 +38,19 @@ const int numBtnPins = (sizeof(btnPins) / sizeof(btnPins[0]));  // count the num
 short btnValues[numBtnPins];
 short prevBtnValues[numBtnPins];
 
+// Pressure mode reads force sensitive resistors on the button pins instead of the buttons (see FsrPressure.h)
+bool toePressureMode = false;
+int pressureDeadband = 2;                // smallest pressure change worth sending
+unsigned long pressureSendIntervalMS = 20;
+unsigned long lastPressureSendMS = 0;
+FsrPressure fsrPressure;
+
 // ESP NOW button data
 typedef struct struct_message {
   float footButton;
   float buttonValue;
+  uint8_t pressureMode;    // 1 when toePressure carries the toes and footButton is -1
+  uint8_t toePressure[2];  // big toe, small toes, 0 to 255
 } struct_message;
 
 // Create a struct_message called buttonData
@@ -36,6 +62,42 @@ esp_now_peer_info_t peerInfo;
 void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
   Serial.print("\r\nLast Packet Send Status:\t");
   Serial.println(status == ESP_NOW_SEND_SUCCESS ? "Delivery Success" : "Delivery Fail");
+
+  if (status == ESP_NOW_SEND_SUCCESS) {
+    ackLatencyUS = micros() - sendStartUS;
+    if (ackLatencyUS > maxAckLatencyUS) maxAckLatencyUS = ackLatencyUS;
+    Serial.print("Ack latency us (last/max): ");
+    Serial.print(ackLatencyUS);
+    Serial.print(" / ");
+    Serial.println(maxAckLatencyUS);
+    sendFailures = 0;
+    channelsSearched = 0;
+  } else {
+    sendFailures++;
+  }
+}
+
+/*
+Method to move ESP-NOW to the next channel when the arm stopped acknowledging,
+the arm only listens on the channel its soft AP is on
+*/
+void searchArmChannel() {
+  // While searching every retry that fails moves on to the next channel, stop after trying all of them
+  if (sendFailures < (channelsSearched > 0 ? 1 : CHANNEL_SEARCH_FAILURES)) return;
+  sendFailures = 0;
+  if (channelsSearched == MAX_RADIO_CHANNEL) return;
+  channelsSearched++;
+
+  armChannel = armChannel % MAX_RADIO_CHANNEL + 1;
+  esp_wifi_set_channel(armChannel, WIFI_SECOND_CHAN_NONE);
+  peerInfo.channel = armChannel;
+  esp_now_mod_peer(&peerInfo);
+
+  Serial.print("Looking for the arm on channel ");
+  Serial.println(armChannel);
+
+  //Retry the latest button state on the new channel
+  sendMessage();
 }
 
 /*
@@ -77,10 +139,20 @@ void setup() {
 
   // Set device as a Wi-Fi Station
   WiFi.mode(WIFI_STA);
+  esp_wifi_set_channel(armChannel, WIFI_SECOND_CHAN_NONE);
+
+  // Pressure mode needs both pins on ADC1, otherwise stay with the buttons
+  if (toePressureMode && fsrPressure.begin(btnPins)) {
+    buttonData.footButton = -1;
+    buttonData.pressureMode = 1;
+  } else if (toePressureMode) {
+    Serial.println("Toe pins are not on ADC1, using buttons");
+    toePressureMode = false;
+  }
 
-  // Set button pin modes
+  // Set button pin modes, the pull ups would throw off the pressure readings
   for (int i = 0; i < numBtnPins; i++) {
-    pinMode(btnPins[i], INPUT_PULLUP);
+    pinMode(btnPins[i], toePressureMode ? INPUT : INPUT_PULLUP);
   }
 
 
@@ -96,7 +168,7 @@ void setup() {
 
   // Register peer
   memcpy(peerInfo.peer_addr, broadcastAddress, 6);
-  peerInfo.channel = 0;
+  peerInfo.channel = armChannel;
   peerInfo.encrypt = false;
 
   // Add peer
@@ -115,8 +187,12 @@ void loop() {
   //Timer start for the sleep trigger
   timeStartStopwatch = millis();
 
-  //Check the buttons presses and transmit
-  processButtons();
+  //Check the buttons presses or toe pressures and transmit
+  if (toePressureMode) {
+    processPressure();
+  } else {
+    processButtons();
+  }
 
   //Time check to see if a button has been pressed after the @param timeElapsed is above 20seconds
   timeElapsed = timeStartStopwatch - timeEndStopwatch;
@@ -127,6 +203,9 @@ void loop() {
 
   //Check Battery Voltage
   checkBattVoltage();
+
+  //Follow the arm if it is not on the channel we are sending on
+  searchArmChannel();
 }
 
 //Foot Buttons
@@ -154,6 +233,30 @@ void processButtons() {
   }
 }
 
+//Toe Pressures
+void processPressure() {
+  if (!fsrPressure.loop()) return;
+  if (millis() - lastPressureSendMS < pressureSendIntervalMS) return;
+
+  // Small changes are left out, except for getting back to 0 so the arm always sees the toe let go
+  bool changed = false;
+  for (short i = 0; i < 2; i++) {
+    uint8_t pressure = fsrPressure.getPressure(i);
+    uint8_t sent = buttonData.toePressure[i];
+    if (pressure == sent) continue;
+    if (abs(pressure - sent) < pressureDeadband && pressure != 0) continue;
+    buttonData.toePressure[i] = pressure;
+    changed = true;
+  }
+  if (!changed) return;
+
+  sendMessage();
+  lastPressureSendMS = millis();
+
+  //Pressing a toe counts as activity for the sleep timer
+  timeEndStopwatch = millis();
+}
+
 void checkBattVoltage() {
   // read the analog / millivolts value for pin 2:
   int analogValue = analogRead(0);
@@ -200,10 +303,16 @@ void goToSleep() {
       //esp_deep_sleep_enable_gpio_wakeup(5,ESP_GPIO_WAKEUP_GPIO_HIGH); //1 = High, 0 = Low
 
       //If you were to use ext1, you would use it like
-      esp_sleep_enable_ext1_wakeup(BUTTON_PIN_BITMASK, ESP_EXT1_WAKEUP_ANY_LOW);
-
-      rtc_gpio_isolate(GPIO_NUM_5);
-      rtc_gpio_isolate(GPIO_NUM_4);
+      if (toePressureMode) {
+        //The FSR pins rest low on their pull down resistors and a press pulls them high. They stay connected so a press can wake the sleeve
+        fsrPressure.end();
+        esp_sleep_enable_ext1_wakeup(BUTTON_PIN_BITMASK, ESP_EXT1_WAKEUP_ANY_HIGH);
+      } else {
+        esp_sleep_enable_ext1_wakeup(BUTTON_PIN_BITMASK, ESP_EXT1_WAKEUP_ANY_LOW);
+
+        rtc_gpio_isolate(GPIO_NUM_5);
+        rtc_gpio_isolate(GPIO_NUM_4);
+      }
       esp_deep_sleep_start();
     }
   }
@@ -211,6 +320,7 @@ void goToSleep() {
 
 void sendMessage() {
   // Send message via ESP-NOW
+  sendStartUS = micros();
   esp_err_t result = esp_now_send(broadcastAddress, (uint8_t *)&buttonData, sizeof(buttonData));
   if (result == ESP_OK) {
     Serial.println("Sent with success");
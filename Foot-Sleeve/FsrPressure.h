@@ -0,0 +1,143 @@
+/*
+  Foot Sleeve Pressure Mode
+
+  Force sensitive resistors on the toe button pins, wired from 3V3 to the pin with a 10k resistor to ground,
+  so the voltage rises with pressure. The pins have to be on ADC1.
+
+  The ADC scans both pins continuously in DMA mode. loop() takes whatever the DMA has collected since the
+  last call, averages it per toe, smooths it and turns it into a pressure of 0 (resting) to 255
+  (fullPressureRaw).
+
+  Depends on
+  https://docs.espressif.com/projects/esp-idf/en/v4.4/esp32/api-reference/peripherals/adc.html
+*/
+
+#include "driver/adc.h"
+
+#define FSR_TOES 2
+#define FSR_SAMPLE_FREQ_HZ 20000  // lowest rate the DMA mode runs at on the ESP32
+#define FSR_READ_BYTES 256
+
+/*
+Smooths the averaged readings of one toe and maps them to a pressure.
+Nothing in here touches the hardware.
+*/
+class PressureFilter {
+  private:
+    float smoothed = 0;
+    float restRaw = 0;
+    bool primed = false;
+
+  public:
+    float alpha = 0.3;             // weight of a new reading, lower is smoother and slower
+    float fullPressureRaw = 3000;  // reading for a full press
+
+    // Add one averaged reading, returns the pressure from 0 to 255
+    uint8_t add(float raw) {
+      if (!primed) {
+        // The toes are resting when the scan starts
+        smoothed = raw;
+        restRaw = raw;
+        primed = true;
+      }
+      smoothed = smoothed + alpha * (raw - smoothed);
+
+      float pressure = (smoothed - restRaw) / (fullPressureRaw - restRaw) * 255;
+      if (pressure < 0) return 0;
+      if (pressure > 255) return 255;
+      return (uint8_t)pressure;
+    }
+};
+
+class FsrPressure {
+  private:
+    int channels[FSR_TOES];
+    uint8_t pressure[FSR_TOES] = { 0, 0 };
+    uint8_t readBuffer[FSR_READ_BYTES];
+    bool scanning = false;
+
+  public:
+    PressureFilter filters[FSR_TOES];
+
+    // Start the DMA scan of the two toe pins, returns false if a pin is not on ADC1
+    bool begin(const int *pins) {
+      adc_digi_pattern_config_t pattern[FSR_TOES] = {};
+      uint32_t channelMask = 0;
+
+      for (int toe = 0; toe < FSR_TOES; toe++) {
+        channels[toe] = digitalPinToAnalogChannel(pins[toe]);
+        if (channels[toe] < 0 || channels[toe] >= SOC_ADC_MAX_CHANNEL_NUM) return false;
+        channelMask |= 1 << channels[toe];
+
+        pattern[toe].atten = ADC_ATTEN_DB_11;
+        pattern[toe].channel = channels[toe];
+        pattern[toe].unit = 0;  // ADC1
+        pattern[toe].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+      }
+
+      adc_digi_init_config_t initConfig = {};
+      initConfig.max_store_buf_size = 1024;
+      initConfig.conv_num_each_intr = FSR_READ_BYTES;
+      initConfig.adc1_chan_mask = channelMask;
+      if (adc_digi_initialize(&initConfig) != ESP_OK) return false;
+
+      adc_digi_configuration_t config = {};
+      config.conv_limit_en = true;
+      config.conv_limit_num = 250;
+      config.pattern_num = FSR_TOES;
+      config.adc_pattern = pattern;
+      config.sample_freq_hz = FSR_SAMPLE_FREQ_HZ;
+      config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+#if CONFIG_IDF_TARGET_ESP32
+      config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+#else
+      config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+#endif
+      adc_digi_controller_configure(&config);
+      adc_digi_start();
+      scanning = true;
+      return true;
+    }
+
+    // Read what the DMA collected, returns true when there was something new
+    bool loop() {
+      if (!scanning) return false;
+
+      uint32_t length = 0;
+      if (adc_digi_read_bytes(readBuffer, FSR_READ_BYTES, &length, 0) != ESP_OK || length == 0) return false;
+
+      long sums[FSR_TOES] = { 0, 0 };
+      int counts[FSR_TOES] = { 0, 0 };
+      for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        adc_digi_output_data_t *result = (adc_digi_output_data_t *)&readBuffer[i];
+#if CONFIG_IDF_TARGET_ESP32
+        int channel = result->type1.channel;
+        int value = result->type1.data;
+#else
+        int channel = result->type2.channel;
+        int value = result->type2.data;
+#endif
+        for (int toe = 0; toe < FSR_TOES; toe++) {
+          if (channel != channels[toe]) continue;
+          sums[toe] += value;
+          counts[toe]++;
+        }
+      }
+
+      for (int toe = 0; toe < FSR_TOES; toe++) {
+        if (counts[toe] > 0) pressure[toe] = filters[toe].add((float)sums[toe] / counts[toe]);
+      }
+      return true;
+    }
+
+    // Stop the scan, needed before deep sleep
+    void end() {
+      if (!scanning) return;
+      adc_digi_stop();
+      adc_digi_deinitialize();
+      scanning = false;
+    }
+
+    bool isScanning() { return scanning; }
+    uint8_t getPressure(int toe) { return pressure[toe]; }
+};
@@ -0,0 +1,311 @@
+/**
+  Foot Controller tilt calibration: replays made up tilt traces of a few kinds of users through the trigger
+  hysteresis, once with the old fixed thresholds and once calibrated, and prints the trigger latency and the
+  false triggers of both
+ */
+
+#include <stdint.h>
+#include "testing.h"
+#include "acceloCalibration.h"
+
+#define SAMPLE_MS 10  // rate of the Foot Controller loop
+
+// Repeatable noise so the numbers do not change between runs
+struct Noise {
+  uint32_t state = 12345;
+  float tremor = 0;
+
+  float uniform() {
+    state = state * 1664525 + 1013904223;
+    return ((state >> 8) + 0.5f) / 16777216.0f;
+  }
+
+  float gaussian() { return sqrtf(-2 * logf(uniform())) * cosf(6.2831853f * uniform()); }
+
+  // Slow tremor and sway, correlated over a few samples like a real foot
+  float next(float sigma) {
+    tremor = 0.9f * tremor + 0.4359f * sigma * gaussian();
+    return tremor;
+  }
+};
+
+struct User {
+  const char *name;
+  float noise;    // g, standard deviation at rest
+  float pitch;    // g, deliberate tilt
+  float yaw;
+  float leakage;  // fraction of a tilt that shows up on the other axis
+};
+
+enum Axis { PITCH, YAW };
+
+struct Tilt {
+  Axis axis;
+  float sign;
+  unsigned long startMS;
+};
+
+// Ramp up, hold, ramp down
+static float tiltShape(unsigned long sinceMS) {
+  const unsigned long rampMS = 300, holdMS = 400;
+  if (sinceMS < rampMS) return (float)sinceMS / rampMS;
+  if (sinceMS < rampMS + holdMS) return 1;
+  if (sinceMS < 2 * rampMS + holdMS) return 1 - (float)(sinceMS - rampMS - holdMS) / rampMS;
+  return 0;
+}
+
+static void tiltOffsets(const User &user, const Tilt &tilt, unsigned long nowMS, float &pitch, float &yaw) {
+  float amount = nowMS >= tilt.startMS ? tilt.sign * tiltShape(nowMS - tilt.startMS) : 0;
+  float main = amount * (tilt.axis == PITCH ? user.pitch : user.yaw);
+  pitch += tilt.axis == PITCH ? main : user.leakage * main;
+  yaw += tilt.axis == YAW ? main : user.leakage * main;
+}
+
+/**
+ * Two seconds still, then forward, back, left and right, the same windows startCalibration() uses
+ */
+static AcceloThresholds calibrate(const User &user, Noise &noise, const AcceloThresholds &current, const Axis *axes = nullptr, int tilts = 4) {
+  static const Axis allAxes[] = { PITCH, PITCH, YAW, YAW };
+  if (!axes) axes = allAxes;
+
+  double sum[2] = {}, squares[2] = {};
+  int samples = 0;
+  for (unsigned long now = 0; now < 2000; now += SAMPLE_MS) {
+    float value[2] = { noise.next(user.noise), noise.next(user.noise) };
+    for (int axis = 0; axis < 2; axis++) {
+      sum[axis] += value[axis];
+      squares[axis] += value[axis] * value[axis];
+    }
+    samples++;
+  }
+  float pitchNoise = sqrt(squares[PITCH] / samples - sum[PITCH] * sum[PITCH] / samples / samples);
+  float yawNoise = sqrt(squares[YAW] / samples - sum[YAW] * sum[YAW] / samples / samples);
+
+  AcceloTiltPeaks peaks;
+  for (unsigned long now = 0; now < 5000; now += SAMPLE_MS) {
+    float pitch = noise.next(user.noise), yaw = noise.next(user.noise);
+    for (int i = 0; i < tilts; i++) {
+      Tilt tilt = { axes[i], i % 2 ? -1.0f : 1.0f, 200 + i * 1200ul };
+      tiltOffsets(user, tilt, now, pitch, yaw);
+    }
+    peaks.add(pitch, yaw, 40 * (fabsf(pitch) + fabsf(yaw)));
+  }
+  return acceloCalibrate(pitchNoise, yawNoise, peaks, current);
+}
+
+struct ReplayResult {
+  int hits;
+  int tilts;
+  float meanLatencyMS;
+  int falseTriggers;  // at rest, or on the axis the user did not tilt
+};
+
+/**
+ * A minute of use: a tilt every three seconds, alternating axes and directions, the foot at rest in between
+ */
+static ReplayResult replay(const User &user, const AcceloThresholds &thresholds, uint32_t seed) {
+  Noise noise;
+  noise.state = seed;
+  ReplayResult result = {};
+  bool crossed[2] = {};
+  bool hit = false;
+  unsigned long latencySumMS = 0;
+  int tilt = -1;
+  Tilt current = { PITCH, 1, 0 };
+
+  for (unsigned long now = 0; now < 60000; now += SAMPLE_MS) {
+    if (now >= 1000 && (now - 1000) % 3000 == 0) {
+      tilt++;
+      result.tilts++;
+      current.axis = tilt % 2 ? YAW : PITCH;
+      current.sign = tilt / 2 % 2 ? -1.0f : 1.0f;
+      current.startMS = now;
+      hit = false;
+    }
+
+    float offset[2] = { noise.next(user.noise), noise.next(user.noise) };
+    bool tilting = tilt >= 0 && now - current.startMS < 1500;
+    if (tilting) tiltOffsets(user, current, now, offset[PITCH], offset[YAW]);
+
+    AcceloAxisEvent event[2] = {
+      acceloAxisUpdate(offset[PITCH], thresholds.pitchOffset, thresholds.pitchRest, crossed[PITCH]),
+      acceloAxisUpdate(offset[YAW], thresholds.yawOffset, thresholds.yawRest, crossed[YAW]),
+    };
+    for (int axis = 0; axis < 2; axis++) {
+      if (event[axis] != ACCELO_AXIS_THRESHOLD) continue;
+      if (tilting && axis == current.axis && !hit) {
+        hit = true;
+        result.hits++;
+        latencySumMS += now - current.startMS;
+      } else if (!tilting || axis != current.axis) {
+        result.falseTriggers++;
+      }
+    }
+  }
+  result.meanLatencyMS = result.hits ? (float)latencySumMS / result.hits : 0;
+  return result;
+}
+
+static void printResult(const char *thresholds, const ReplayResult &result) {
+  printf("  %-10s hits %2d/%d  mean latency %5.0f ms  false triggers %d\n", thresholds, result.hits, result.tilts, result.meanLatencyMS, result.falseTriggers);
+}
+
+static void printThresholds(const AcceloThresholds &thresholds) {
+  printf("  calibrated pitch %.3f/%.3f  yaw %.3f/%.3f  sleep gyro %.0f\n", thresholds.pitchOffset, thresholds.pitchRest, thresholds.yawOffset,
+         thresholds.yawRest, thresholds.sleepGyro);
+}
+
+static void testUsers() {
+  const User light = { "light tilts", 0.01f, 0.25f, 0.2f, 0.2f };
+  const User typical = { "typical", 0.015f, 0.45f, 0.35f, 0.25f };
+  const User tremor = { "tremor", 0.05f, 0.6f, 0.5f, 0.3f };
+
+  const User *users[] = { &light, &typical, &tremor };
+  ReplayResult fixed[3], calibrated[3];
+  for (int i = 0; i < 3; i++) {
+    Noise noise;
+    AcceloThresholds thresholds = calibrate(*users[i], noise, acceloDefaultThresholds);
+    fixed[i] = replay(*users[i], acceloDefaultThresholds, 777 + i);
+    calibrated[i] = replay(*users[i], thresholds, 777 + i);
+
+    printf("%s\n", users[i]->name);
+    printThresholds(thresholds);
+    printResult("fixed", fixed[i]);
+    printResult("calibrated", calibrated[i]);
+  }
+
+  // Light tilts never reach the fixed pitch threshold, calibrated they trigger sooner on both axes
+  CHECK(fixed[0].hits < fixed[0].tilts);
+  CHECK(calibrated[0].hits == calibrated[0].tilts);
+  CHECK(calibrated[0].falseTriggers == 0);
+
+  // Nothing lost for a typical user
+  CHECK(calibrated[1].hits == calibrated[1].tilts);
+  CHECK(calibrated[1].falseTriggers == 0);
+  CHECK(calibrated[1].meanLatencyMS <= fixed[1].meanLatencyMS);
+
+  // A shaky foot sets off the fixed thresholds at rest, calibrated it trades a little latency for none
+  CHECK(fixed[2].falseTriggers > 0);
+  CHECK(calibrated[2].hits == calibrated[2].tilts);
+  CHECK(calibrated[2].falseTriggers == 0);
+  CHECK(calibrated[2].meanLatencyMS >= fixed[2].meanLatencyMS);
+}
+
+static void testCrossAxisLeakage() {
+  // Only pitch tilted, a third of it leaks into yaw
+  const User user = { "pitch only", 0.01f, 0.5f, 0.5f, 0.35f };
+  const Axis pitchOnly[] = { PITCH, PITCH };
+  Noise noise;
+  AcceloThresholds thresholds = calibrate(user, noise, acceloDefaultThresholds, pitchOnly, 2);
+  CHECK_NEAR(thresholds.pitchOffset, 0.2f, 0.02f);
+  CHECK(thresholds.yawOffset == acceloDefaultThresholds.yawOffset);
+  CHECK(thresholds.yawRest == acceloDefaultThresholds.yawRest);
+
+  // Leakage riding along with a bigger tilt never counts towards the other axis
+  AcceloTiltPeaks peaks;
+  peaks.add(0.3f, 0.1f, 0);
+  peaks.add(-0.4f, 0.14f, 0);
+  CHECK_NEAR(peaks.pitch, 0.4f, 1e-6f);
+  CHECK(peaks.yaw == 0);
+  CHECK_NEAR(peaks.yawLeakage, 0.14f, 1e-6f);
+  thresholds = acceloCalibrate(0.005f, 0.005f, peaks, acceloDefaultThresholds);
+  CHECK(thresholds.yawOffset == acceloDefaultThresholds.yawOffset);
+
+  // A tilt under minTilt is not trusted even on a quiet sensor
+  AcceloTiltPeaks small;
+  small.add(0.1f, 0, 0);
+  thresholds = acceloCalibrate(0.001f, 0.001f, small, acceloDefaultThresholds);
+  CHECK(thresholds.pitchOffset == acceloDefaultThresholds.pitchOffset);
+}
+
+static void testSleepGyro() {
+  AcceloTiltPeaks peaks;
+  peaks.add(0.4f, 0, 100);
+  AcceloThresholds first = acceloCalibrate(0.01f, 0.01f, peaks, acceloDefaultThresholds);
+  CHECK_NEAR(first.sleepGyro, 150, 1e-3f);
+
+  // A calmer second calibration lowers it again instead of keeping the larger one
+  AcceloTiltPeaks calmer;
+  calmer.add(0.4f, 0, 20);
+  AcceloThresholds second = acceloCalibrate(0.01f, 0.01f, calmer, first);
+  CHECK_NEAR(second.sleepGyro, acceloCalibrationSettings.sleepGyroMin, 1e-3f);
+
+  // A stomp during calibration cannot switch walking detection off
+  AcceloTiltPeaks stomp;
+  stomp.add(0.4f, 0, 1000);
+  CHECK_NEAR(acceloCalibrate(0.01f, 0.01f, stomp, second).sleepGyro, acceloCalibrationSettings.sleepGyroMax, 1e-3f);
+  CHECK_NEAR(acceloClampSleepGyro(5000), acceloCalibrationSettings.sleepGyroMax, 1e-3f);
+}
+
+static void testHysteresis() {
+  bool crossed = false;
+  CHECK(acceloAxisUpdate(0.2f, 0.3f, 0.15f, crossed) == ACCELO_AXIS_NONE);
+  CHECK(acceloAxisUpdate(-0.31f, 0.3f, 0.15f, crossed) == ACCELO_AXIS_THRESHOLD);
+  CHECK(crossed);
+  CHECK(acceloAxisUpdate(0.4f, 0.3f, 0.15f, crossed) == ACCELO_AXIS_NONE);
+  CHECK(acceloAxisUpdate(0.2f, 0.3f, 0.15f, crossed) == ACCELO_AXIS_NONE);
+  CHECK(acceloAxisUpdate(0.1f, 0.3f, 0.15f, crossed) == ACCELO_AXIS_REST);
+  CHECK(!crossed);
+}
+
+/**
+ * One axis of the trigger run every loopMS with rest drift tracking, like loop() and trackRestDrift(): the sensor
+ * drifts by driftPerMinute, and from tiltStartMS the foot tilts slowly by tiltPerS up to 0.5 g
+ * @returns when the threshold was crossed, 0 if never
+ */
+static unsigned long runDrift(float driftPerMinute, float tiltPerS, unsigned long tiltStartMS, unsigned long lengthMS, unsigned long loopMS,
+                              const AcceloDriftSettings &settings, float &finalOffset) {
+  const AcceloThresholds &thresholds = acceloDefaultThresholds;
+  Noise noise;
+  float rest = 0;
+  bool crossed = false;
+  for (unsigned long now = loopMS; now <= lengthMS; now += loopMS) {
+    float value = driftPerMinute * now / 60000 + noise.next(0.01f);
+    if (now > tiltStartMS) value += fminf(tiltPerS * (now - tiltStartMS) / 1000, 0.5f);
+    float offset = value - rest;
+    finalOffset = offset;
+    if (!crossed) acceloTrackDrift(rest, offset, offset, 0, thresholds.pitchRest, thresholds.yawRest, loopMS, settings);
+    if (acceloAxisUpdate(offset, thresholds.pitchOffset, thresholds.pitchRest, crossed) == ACCELO_AXIS_THRESHOLD) return now;
+  }
+  return 0;
+}
+
+static void testRestDrift() {
+  // What 0.001 of the offset every pass was for a loop running every millisecond
+  const AcceloDriftSettings perPass = { 1, 1000 };
+  const AcceloDriftSettings none = { 1e9f, 1000 };
+  float offset, fastOffset, untracked;
+  printf("rest drift, 0.01 g a minute for ten minutes\n");
+
+  // Drift is taken out the same at a 10 ms and a 1 ms loop
+  CHECK(runDrift(0.01f, 0, 0, 600000, 10, acceloDriftSettings, offset) == 0);
+  CHECK(runDrift(0.01f, 0, 0, 600000, 1, acceloDriftSettings, fastOffset) == 0);
+  runDrift(0.01f, 0, 0, 600000, 10, none, untracked);
+  printf("  offset left %.3f g at 10 ms, %.3f g at 1 ms, %.3f g untracked\n", offset, fastOffset, untracked);
+  CHECK(fabsf(offset) < 0.03f);
+  CHECK(fabsf(fastOffset) < 0.03f);
+  CHECK(untracked > 0.09f);
+
+  // A slow tilt, 0.04 g a second after a minute of drift, still crosses the threshold at either loop rate
+  printf("slow tilt, 0.04 g a second\n");
+  unsigned long crossedAt = runDrift(0.01f, 0.04f, 60000, 80000, 10, acceloDriftSettings, offset);
+  unsigned long fastCrossedAt = runDrift(0.01f, 0.04f, 60000, 80000, 1, acceloDriftSettings, offset);
+  unsigned long perPassCrossedAt = runDrift(0.01f, 0.04f, 60000, 80000, 1, perPass, offset);
+  printf("  crossed after %lu ms at 10 ms, %lu ms at 1 ms, %s with 0.001 a pass at 1 ms\n", crossedAt - 60000, fastCrossedAt - 60000,
+         perPassCrossedAt ? "crossed" : "never crossed");
+  CHECK(crossedAt > 60000 && crossedAt - 60000 < 9000);
+  CHECK(fastCrossedAt > 60000 && fastCrossedAt - 60000 < 9000);
+  CHECK(perPassCrossedAt == 0);
+
+  // Long gaps between passes count as maxStepMS
+  CHECK_NEAR(acceloDriftStep(60000), acceloDriftStep(acceloDriftSettings.maxStepMS), 1e-6f);
+}
+
+int main() {
+  testUsers();
+  testCrossAxisLeakage();
+  testSleepGyro();
+  testHysteresis();
+  testRestDrift();
+  return testResult("acceloCalibrationTest");
+}
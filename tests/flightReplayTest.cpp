@@ -0,0 +1,136 @@
+/**
+  Flight recording replay: header checks, gestures replayed from recorded toe edges, servo records
+ */
+
+#include "testing.h"
+#include "flightReplay.h"
+
+struct Recording {
+  uint8_t data[sizeof(FlightRecordingHeader) + 32 * sizeof(FlightRecord)];
+  uint32_t count = 0;
+
+  void add(uint32_t timeUS, uint8_t type, uint8_t source, int16_t a, int32_t b) {
+    FlightRecord record = { timeUS, type, source, a, b };
+    memcpy(data + sizeof(FlightRecordingHeader) + count * sizeof(FlightRecord), &record, sizeof(record));
+    count++;
+  }
+
+  size_t finish() {
+    FlightRecordingHeader header = { FLIGHT_RECORDER_MAGIC, FLIGHT_RECORDER_VERSION, sizeof(FlightRecord), count, 0, 0 };
+    memcpy(data, &header, sizeof(header));
+    return sizeof(header) + count * sizeof(FlightRecord);
+  }
+};
+
+// Big toe tap then small toe tap, as the arm records it from the Foot Sleeve
+static void addNextModeGesture(Recording &recording, uint32_t atUS, int16_t recordedAction) {
+  recording.add(atUS, RECORD_TOE_EDGE, SOURCE_FOOT_SLEEVE, BIG_TOE, 1);
+  recording.add(atUS + 20000, RECORD_TOE_EDGE, SOURCE_FOOT_SLEEVE, BIG_TOE, 1);  // repeated packet
+  recording.add(atUS + 100000, RECORD_TOE_EDGE, SOURCE_FOOT_SLEEVE, BIG_TOE, 0);
+  recording.add(atUS + 300000, RECORD_TOE_EDGE, SOURCE_FOOT_SLEEVE, SMALL_TOE, 1);
+  recording.add(atUS + 400000, RECORD_TOE_EDGE, SOURCE_FOOT_SLEEVE, SMALL_TOE, 0);
+  recording.add(atUS + 401000, RECORD_GESTURE, SOURCE_ARM, recordedAction, 0);
+  recording.add(atUS + 401000, RECORD_MODE, SOURCE_ARM, 1, 0);
+}
+
+static void testHeaderChecks() {
+  Recording recording;
+  size_t length = recording.finish();
+  CHECK(FlightReplay::check(recording.data, length) == nullptr);
+  CHECK(FlightReplay::check(recording.data, 4) != nullptr);
+
+  recording.add(0, RECORD_BOOT, SOURCE_ARM, 0, 1);
+  recording.finish();
+  CHECK(FlightReplay::check(recording.data, length) != nullptr);  // header says one record, none there
+
+  recording.data[0] ^= 0xFF;
+  CHECK(FlightReplay::check(recording.data, sizeof(recording.data)) != nullptr);
+}
+
+static void testGestureMatches() {
+  Recording recording;
+  recording.add(1000, RECORD_BOOT, SOURCE_ARM, 0, 1);
+  addNextModeGesture(recording, 2000000, ACTION_NEXT_MODE);
+  recording.add(2500000, RECORD_SERVO, JOINT_INDEX, indexTable.pulseUS[0], 0);
+  size_t length = recording.finish();
+
+  FlightReplay replay(nullptr);
+  replay.run(recording.data, length);
+  FlightReplayStats stats = replay.getStats();
+  CHECK(stats.records == 9);
+  CHECK(stats.boots == 1);
+  CHECK(stats.toeEdges == 5);
+  CHECK(stats.servoRecords == 1);
+  CHECK(stats.recordedGestures == 1);
+  CHECK(stats.replayedGestures == 1);
+  CHECK(stats.gestureMismatches == 0);
+}
+
+static void testGestureMismatch() {
+  Recording recording;
+  addNextModeGesture(recording, 1000000, ACTION_WRIST_LOCK);
+  size_t length = recording.finish();
+
+  FlightReplay replay(nullptr);
+  replay.run(recording.data, length);
+  CHECK(replay.getStats().gestureMismatches == 1);
+}
+
+// Pressure mode: the pressures as the arm records them, and the virtual presses it made from them
+static void testPressureEdges() {
+  Recording recording;
+  recording.add(1000, RECORD_BOOT, SOURCE_ARM, 0, 1);
+  recording.add(100000, RECORD_TOE_PRESSURE, SOURCE_FOOT_CONTROLLER, BIG_TOE, 60);
+  recording.add(120000, RECORD_TOE_PRESSURE, SOURCE_FOOT_CONTROLLER, BIG_TOE, 150);
+  recording.add(120000, RECORD_TOE_EDGE, SOURCE_ARM, BIG_TOE, 1);
+  recording.add(140000, RECORD_TOE_PRESSURE, SOURCE_FOOT_CONTROLLER, BIG_TOE, 50);  // inside the hysteresis, still down
+  recording.add(160000, RECORD_TOE_PRESSURE, SOURCE_FOOT_CONTROLLER, BIG_TOE, 10);
+  recording.add(160000, RECORD_TOE_EDGE, SOURCE_ARM, BIG_TOE, 0);
+  size_t length = recording.finish();
+
+  FlightReplay replay(nullptr);
+  replay.run(recording.data, length);
+  FlightReplayStats stats = replay.getStats();
+  CHECK(stats.toePressures == 4);
+  CHECK(stats.toeEdges == 2);
+  CHECK(stats.pressureMismatches == 0);
+
+  // A press the recorded pressure does not make
+  Recording wrong;
+  wrong.add(100000, RECORD_TOE_PRESSURE, SOURCE_FOOT_CONTROLLER, SMALL_TOE, 60);
+  wrong.add(100000, RECORD_TOE_EDGE, SOURCE_ARM, SMALL_TOE, 1);
+  length = wrong.finish();
+  FlightReplay wrongReplay(nullptr);
+  wrongReplay.run(wrong.data, length);
+  CHECK(wrongReplay.getStats().pressureMismatches == 1);
+}
+
+// micros() wraps around every ~71 minutes, the replay has to keep the order of the edges
+static void testTimeWrap() {
+  Recording recording;
+  addNextModeGesture(recording, 0xFFFFFFFF - 150000, ACTION_NEXT_MODE);
+  size_t length = recording.finish();
+
+  FlightReplay replay(nullptr);
+  replay.run(recording.data, length);
+  CHECK(replay.getStats().recordedGestures == 1);
+  CHECK(replay.getStats().gestureMismatches == 0);
+}
+
+static void testJointPositions() {
+  CHECK_NEAR(jointPosition(indexTable, indexTable.pulseUS[0]), 0.0f, 0.001f);
+  CHECK_NEAR(jointPosition(indexTable, indexTable.pulseUS[JOINT_TABLE_SIZE - 1]), 1.0f, 0.001f);
+  CHECK_NEAR(jointPosition(ringTable, jointPulseUS(ringTable, 0.3f)), 0.3f, 0.01f);
+  CHECK_NEAR(jointPosition(thumbTable, jointPulseUS(thumbTable, 0.75f)), 0.75f, 0.01f);
+  CHECK(jointPosition(ringTable, SERVO_MAX_PULSE_US) == 1);  // past the closed end
+}
+
+int main() {
+  testHeaderChecks();
+  testGestureMatches();
+  testGestureMismatch();
+  testPressureEdges();
+  testTimeWrap();
+  testJointPositions();
+  return testResult("flightReplayTest");
+}
@@ -0,0 +1,178 @@
+/**
+  Hand pre-shaping: the glide from the rest position, and a simulation of the time from pressing the big toe
+  until each grip reaches its object, with and without pre-shaping, for a few delays between the mode change
+  and the press
+ */
+
+#include "testing.h"
+#include "servoSchedule.h"
+#include "jointCalibration.h"
+
+ServoSchedule servoSchedule;
+
+// Host stand in for the JointServo in servoOutput.h, it stages the same pulses
+class JointServo {
+  private:
+    uint8_t joint;
+    const JointTable *calibration;
+    float position = -1;
+
+  public:
+    JointServo(uint8_t joint, const JointTable *calibration = nullptr) : joint(joint), calibration(calibration) {}
+
+    void writePosition(float newPosition) {
+      if (!calibration) return;
+      position = newPosition < 0 ? 0 : newPosition > 1 ? 1 : newPosition;
+      servoSchedule.stage(joint, jointPulseUS(*calibration, position));
+    }
+
+    float readPosition() { return position; }
+};
+
+#include "toeGestures.h"
+#include "handConfig.h"
+#include "handPreshape.h"
+
+#define PASS_MS 10            // one control tick of the arm
+#define CONTACT_POSITION 0.5  // fingers closed this far reach a mid sized object
+
+struct Hand {
+  JointServo thumb = JointServo(JOINT_THUMB, &thumbTable);
+  JointServo thumbBase = JointServo(JOINT_THUMB_BASE, &thumbBaseTable);
+  JointServo index = JointServo(JOINT_INDEX, &indexTable);
+  JointServo middle = JointServo(JOINT_MIDDLE, &middleTable);
+  JointServo ring = JointServo(JOINT_RING, &ringTable);
+  JointServo pinky = JointServo(JOINT_PINK, &pinkTable);
+  JointServo *joints[SERVO_JOINT_COUNT] = { &thumb, &thumbBase, &index, &middle, &ring, &pinky, nullptr, nullptr };
+};
+
+const int poseCount = sizeof(preshapePoses) / sizeof(preshapePoses[0]);
+const float thumbBaseMax[] = { thumbBaseGripMax, thumbBasePinchMax, thumbBaseTripodMax, thumbBasePointMax };
+
+/**
+ * Pick a finger mode on a hand nothing has moved yet, press the big toe pressAfterMS later and hold it.
+ * The grip passes follow processToeButtons(): the fingers close by fingerStep per pass, the thumb base of the
+ * pinch, tripod and point starts no lower than thumbBaseDefault and turns in by thumbBaseStep up to the pose maximum.
+ * @returns ms from the press until the fingers reach CONTACT_POSITION and the thumb base its maximum
+ */
+static unsigned long pressToContactMS(int fingerType, unsigned long pressAfterMS, bool preshape) {
+  servoSchedule = ServoSchedule();
+  Hand hand;
+  HandPreshaper preshaper(hand.joints, handRestPosition, preshapePoses, poseCount);
+  float thumbBaseMovement = 0;
+
+  if (preshape) {
+    preshaper.start(fingerType, 0);
+    for (unsigned long now = PASS_MS; now <= pressAfterMS; now += PASS_MS) preshaper.update(now);
+    if (hand.thumbBase.readPosition() >= 0) thumbBaseMovement = hand.thumbBase.readPosition();
+  }
+
+  float fingerPos = 0;
+  for (int pass = 1; pass < 1000; pass++) {
+    if (fingerType != 0) {
+      if (thumbBaseMovement >= thumbBaseMax[fingerType]) thumbBaseMovement = thumbBaseMax[fingerType];
+      if (thumbBaseMovement <= thumbBaseDefault) thumbBaseMovement = thumbBaseDefault;
+      hand.thumbBase.writePosition(thumbBaseMovement);
+    }
+    hand.index.writePosition(fingerPos);
+
+    bool thumbBaseThere = fingerType == 0 || hand.thumbBase.readPosition() >= thumbBaseMax[fingerType] - 1e-4f;
+    if (fingerPos >= CONTACT_POSITION && thumbBaseThere) return pass * PASS_MS;
+
+    fingerPos = fingerPos + fingerStep;
+    thumbBaseMovement = thumbBaseMovement + thumbBaseStep;
+  }
+  return 0;
+}
+
+static void testPressToContact() {
+  const unsigned long pressAfter[] = { 0, 250, 500, 750, 1000 };
+  printf("press to contact ms, without / with pre-shaping\n");
+  printf("  %-8s", "grip");
+  for (unsigned long ms : pressAfter) printf("  press after %4lu ms", ms);
+  printf("\n");
+
+  for (int fingerType = 0; fingerType < poseCount; fingerType++) {
+    printf("  %-8s", preshapePoses[fingerType].name);
+    unsigned long previousWith = 0;
+    for (unsigned long ms : pressAfter) {
+      unsigned long without = pressToContactMS(fingerType, ms, false);
+      unsigned long with = pressToContactMS(fingerType, ms, true);
+      printf("  %9lu / %-7lu", without, with);
+
+      CHECK(with > 0 && without > 0);
+      CHECK(with <= without);
+      // Waiting longer before pressing never makes the pre-shaped grip slower
+      if (previousWith) CHECK(with <= previousWith);
+      previousWith = with;
+    }
+    printf("\n");
+  }
+
+  // Grip and Pinch are not pre-shaped, the grips that turn the thumb base far gain once the glide has had time
+  CHECK(pressToContactMS(0, 1000, true) == pressToContactMS(0, 1000, false));
+  CHECK(pressToContactMS(1, 1000, true) == pressToContactMS(1, 1000, false));
+  CHECK(pressToContactMS(2, 1000, true) + 100 <= pressToContactMS(2, 1000, false));
+  CHECK(pressToContactMS(3, 1000, true) + 200 <= pressToContactMS(3, 1000, false));
+  CHECK(pressToContactMS(3, 0, true) == pressToContactMS(3, 0, false));
+}
+
+static void testGlideFromRest() {
+  servoSchedule = ServoSchedule();
+  Hand hand;
+  HandPreshaper preshaper(hand.joints, handRestPosition, preshapePoses, poseCount);
+
+  // Nothing wrote the thumb base yet, it starts from the open hand instead of jumping to 0.5
+  preshaper.start(2, 0);
+  CHECK(preshaper.update(100));
+  CHECK_NEAR(hand.thumbBase.readPosition(), 0.06f, 1e-4f);
+  CHECK_NEAR(hand.ring.readPosition(), 0, 1e-6f);
+  CHECK(hand.index.readPosition() < 0);  // PRESHAPE_KEEP in the tripod row
+
+  // 0.6 positions per second
+  preshaper.update(500);
+  CHECK_NEAR(hand.thumbBase.readPosition(), 0.3f, 1e-4f);
+  CHECK(!preshaper.update(1000));
+  CHECK_NEAR(hand.thumbBase.readPosition(), 0.5f, 1e-4f);
+  CHECK(!preshaper.isActive());
+
+  // A written joint carries on from where it is
+  hand.thumbBase.writePosition(0.8f);
+  preshaper.start(3, 2000);
+  preshaper.update(2100);
+  CHECK_NEAR(hand.thumbBase.readPosition(), 0.74f, 1e-4f);
+}
+
+static void testModesWithoutPreshaping() {
+  servoSchedule = ServoSchedule();
+  Hand hand;
+  HandPreshaper preshaper(hand.joints, handRestPosition, preshapePoses, poseCount);
+
+  // Picking Grip or Pinch moves no servo at all
+  for (int fingerType = 0; fingerType < 2; fingerType++) {
+    preshaper.start(fingerType, 0);
+    CHECK(!preshaper.isActive());
+    CHECK(!preshaper.update(500));
+    for (JointServo *joint : hand.joints) CHECK(!joint || joint->readPosition() < 0);
+  }
+}
+
+static void testNoRestPosition() {
+  servoSchedule = ServoSchedule();
+  Hand hand;
+  const float unknownRest[SERVO_JOINT_COUNT] = { PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP, PRESHAPE_KEEP };
+  HandPreshaper preshaper(hand.joints, unknownRest, preshapePoses, poseCount);
+
+  // Without a rest position there is nothing to glide from
+  preshaper.start(2, 0);
+  preshaper.update(10);
+  CHECK_NEAR(hand.thumbBase.readPosition(), 0.5f, 1e-6f);
+}
+
+int main() {
+  testPressToContact();
+  testGlideFromRest();
+  testModesWithoutPreshaping();
+  testNoRestPosition();
+  return testResult("handPreshapeTest");
+}
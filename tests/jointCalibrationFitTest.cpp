@@ -0,0 +1,110 @@
+/**
+  Joint calibration fit: fits made up angle samples of joints that move unevenly and checks the table against
+  the true joint, next to a straight line between the open and closed pulse widths
+ */
+
+#include "testing.h"
+#include "jointCalibrationFit.h"
+
+// Repeatable measuring noise, within +-amplitude degrees
+static float measuringNoise(uint32_t &state, float amplitude) {
+  state = state * 1664525 + 1013904223;
+  return ((state >> 8) / 16777216.0f * 2 - 1) * amplitude;
+}
+
+/**
+ * A finger whose tendon pulls slowly at first and faster once it wraps around the knuckle, closing with a
+ * shorter pulse like the index. Open at 10 degrees, closed at 100.
+ */
+static float fingerAngle(uint16_t pulseUS) {
+  float servo = (2100 - (float)pulseUS) / (2100 - 900);
+  if (servo < 0) servo = 0;
+  if (servo > 1) servo = 1;
+  return 10 + 90 * servo * (0.3f + 0.7f * servo);
+}
+
+// Against the true joint, without the measuring noise
+static float trueMaxError(const JointTable &table) {
+  float maxError = 0;
+  for (int step = 0; step <= 100; step++) {
+    float position = step / 100.0f;
+    float angle = fingerAngle(jointPulseUS(table, position));
+    maxError = fmaxf(maxError, fabsf((angle - 10) / 90 - position));
+  }
+  return maxError;
+}
+
+static int measureFinger(AngleSample *samples, float noise) {
+  uint32_t state = 99;
+  int count = 0;
+  for (int pulseUS = 900; pulseUS <= 2100; pulseUS += 25) {
+    samples[count].pulseUS = pulseUS;
+    samples[count].angle = fingerAngle(pulseUS) + measuringNoise(state, noise);
+    count++;
+  }
+  return count;
+}
+
+static void testUnevenFinger() {
+  AngleSample samples[FIT_MAX_SAMPLES];
+  int count = measureFinger(samples, 1);
+  JointFit fit;
+  CHECK(fitJointCalibration(samples, count, 10, 100, 5, fit) == nullptr);
+  printf("  uneven finger: max error %.3f, open and closed points alone %.3f\n", fit.maxError, fit.twoPointMaxError);
+
+  // Closes with a shorter pulse, so the points fall
+  CHECK(fit.points[0].pulseUS > 2050);
+  CHECK(fit.points[fit.pointCount - 1].pulseUS < 950);
+  for (int point = 1; point < fit.pointCount; point++) CHECK(fit.points[point].pulseUS < fit.points[point - 1].pulseUS);
+
+  float trueError = trueMaxError(fit.table);
+  printf("  uneven finger: max error against the true joint %.3f\n", trueError);
+  CHECK(trueError < 0.04f);
+  CHECK(fit.twoPointMaxError > 0.15f);
+  CHECK(fit.maxError < fit.twoPointMaxError / 3);
+
+  // More points follow the curve closer
+  JointFit fine;
+  CHECK(fitJointCalibration(samples, count, 10, 100, 9, fine) == nullptr);
+  printf("  uneven finger, 9 points: max error against the true joint %.3f\n", trueMaxError(fine.table));
+  CHECK(trueMaxError(fine.table) < trueError);
+}
+
+static void testRisingJoint() {
+  // Mounted the other way round like the ring and pinky, straight, measured out of order with a repeated pulse
+  const AngleSample samples[] = { { 1500, 45 }, { 544, 0 }, { 2400, 90 }, { 1000, 23 }, { 2000, 68 }, { 1500, 44 } };
+  JointFit fit;
+  CHECK(fitJointCalibration(samples, 6, 0, 90, 3, fit) == nullptr);
+  CHECK(fit.points[0].pulseUS == 544);
+  CHECK(fit.points[2].pulseUS == 2400);
+  CHECK(fit.points[1].pulseUS > 1450 && fit.points[1].pulseUS < 1550);
+  CHECK(fit.maxError < 0.05f);
+}
+
+static void testNoisyDeadband() {
+  // A servo that does not move the finger for the first 200 us, with a sample that went backwards
+  const AngleSample samples[] = { { 1000, 0 }, { 1100, 1 }, { 1200, 0 }, { 1300, 20 }, { 1400, 18 }, { 1500, 50 }, { 1600, 80 }, { 1700, 100 } };
+  JointFit fit;
+  CHECK(fitJointCalibration(samples, 8, 0, 100, 5, fit) == nullptr);
+  CHECK(fit.points[0].pulseUS <= 1200);
+  for (int point = 1; point < fit.pointCount; point++) CHECK(fit.points[point].pulseUS >= fit.points[point - 1].pulseUS);
+  CHECK(fit.points[fit.pointCount - 1].pulseUS == 1700);
+}
+
+static void testBadSamples() {
+  // The finger was never measured closed
+  const AngleSample partly[] = { { 1000, 0 }, { 1500, 30 }, { 2000, 60 } };
+  JointFit fit;
+  CHECK(fitJointCalibration(partly, 3, 0, 100, 5, fit) != nullptr);
+  CHECK(fitJointCalibration(partly, 1, 0, 60, 5, fit) != nullptr);
+  CHECK(fitJointCalibration(partly, 3, 0, 60, JOINT_TABLE_SIZE + 1, fit) != nullptr);
+  CHECK(fitJointCalibration(partly, 3, 30, 30, 5, fit) != nullptr);
+}
+
+int main() {
+  testUnevenFinger();
+  testRisingJoint();
+  testNoisyDeadband();
+  testBadSamples();
+  return testResult("jointCalibrationFitTest");
+}
@@ -0,0 +1,118 @@
+/**
+  Servo schedule: pulse conversion, staging, commits, stagger and the measured tick to pulse skew
+ */
+
+#include "testing.h"
+#include "servoSchedule.h"
+
+static void testDegreeConversion() {
+  CHECK(ServoSchedule::degreesToPulseUS(0) == SERVO_MIN_PULSE_US);
+  CHECK(ServoSchedule::degreesToPulseUS(180) == SERVO_MAX_PULSE_US);
+  CHECK(ServoSchedule::degreesToPulseUS(-20) == SERVO_MIN_PULSE_US);
+  CHECK(ServoSchedule::degreesToPulseUS(400) == SERVO_MAX_PULSE_US);
+  CHECK(ServoSchedule::degreesToPulseUS(90) == 1472);
+}
+
+static void testStaging() {
+  ServoSchedule schedule;
+  CHECK(!schedule.hasChanges());
+
+  schedule.stage(JOINT_INDEX, 1500);
+  CHECK(schedule.hasChanges());
+  CHECK(schedule.getStagedPulseUS(JOINT_INDEX) == 1500);
+  CHECK(schedule.getPulseUS(JOINT_INDEX) == 0);
+
+  const uint16_t *committed = schedule.commit();
+  CHECK(committed[JOINT_INDEX] == 1500);
+  CHECK(!schedule.hasChanges());
+
+  // Same value again is not a change, out of range values are clamped, 0 keeps the output low
+  schedule.stage(JOINT_INDEX, 1500);
+  CHECK(!schedule.hasChanges());
+  schedule.stage(JOINT_THUMB, 100);
+  CHECK(schedule.getStagedPulseUS(JOINT_THUMB) == SERVO_MIN_PULSE_US);
+  schedule.stage(JOINT_THUMB, 5000);
+  CHECK(schedule.getStagedPulseUS(JOINT_THUMB) == SERVO_MAX_PULSE_US);
+  schedule.stage(JOINT_THUMB, 0);
+  CHECK(schedule.getStagedPulseUS(JOINT_THUMB) == 0);
+  schedule.stage(SERVO_JOINT_COUNT, 1500);
+  CHECK(schedule.getStagedPulseUS(SERVO_JOINT_COUNT) == 0);
+}
+
+static void testStagger() {
+  ServoSchedule schedule;
+  CHECK(schedule.phaseOffsetUS(JOINT_BENDING) == 7 * 500);
+
+  // The last joint's longest pulse still has to fit in the period
+  schedule.setStaggerUS(2500);
+  CHECK(schedule.getStaggerUS() == 2500);
+  schedule.setStaggerUS(3000);
+  CHECK(schedule.getStaggerUS() == 2500);
+}
+
+static void attachAll(ServoSchedule &schedule) {
+  for (int joint = 0; joint < SERVO_JOINT_COUNT; joint++) schedule.setPin(joint, joint + 10);
+}
+
+static void testCommitWithinOnePeriod() {
+  ServoSchedule schedule;
+  attachAll(schedule);
+  CHECK(schedule.configuredSpreadUS() == 3500);
+
+  unsigned long jointPhaseUS[SERVO_JOINT_COUNT];
+  for (int joint = 0; joint < SERVO_JOINT_COUNT; joint++) jointPhaseUS[joint] = 5000 + joint * 10;
+  schedule.recordCommit(4990, jointPhaseUS, 90);
+
+  ServoSkewStats stats = schedule.getStats();
+  CHECK(stats.commits == 1);
+  CHECK(stats.splitCommits == 0);
+  CHECK(stats.tickToPulseMinUS == SERVO_PERIOD_US - 4990);
+  CHECK(stats.tickToPulseMaxUS == SERVO_PERIOD_US - 4990 + 3500);
+  CHECK(stats.jointSkewUS == schedule.configuredSpreadUS());
+}
+
+static void testCommitAcrossPeriodStart() {
+  ServoSchedule schedule;
+  attachAll(schedule);
+
+  // The timer wrapped after the fourth joint, the rest latch one period later
+  unsigned long jointPhaseUS[SERVO_JOINT_COUNT] = { 19950, 19970, 19990, 19995, 10, 30, 50, 70 };
+  schedule.recordCommit(19940, jointPhaseUS, 150);
+
+  ServoSkewStats stats = schedule.getStats();
+  CHECK(stats.splitCommits == 1);
+  CHECK(stats.tickToPulseMinUS == SERVO_PERIOD_US - 19940);
+  CHECK(stats.tickToPulseMaxUS == 2 * SERVO_PERIOD_US - 19940 + 3500);
+  CHECK(stats.jointSkewUS == SERVO_PERIOD_US + 3500);
+  CHECK(stats.maxJointSkewUS == SERVO_PERIOD_US + 3500);
+
+  // The maximum is kept after a clean commit
+  for (int joint = 0; joint < SERVO_JOINT_COUNT; joint++) jointPhaseUS[joint] = 100 + joint;
+  schedule.recordCommit(90, jointPhaseUS, 20);
+  stats = schedule.getStats();
+  CHECK(stats.jointSkewUS == 3500);
+  CHECK(stats.maxJointSkewUS == SERVO_PERIOD_US + 3500);
+}
+
+static void testOnlyAttachedJointsCount() {
+  ServoSchedule schedule;
+  schedule.setPin(JOINT_INDEX, 25);
+  schedule.setPin(JOINT_PINK, 27);
+  CHECK(schedule.configuredSpreadUS() == 3 * 500);
+
+  // An unattached joint's stale phase must not look like a wrap
+  unsigned long jointPhaseUS[SERVO_JOINT_COUNT] = { 0, 0, 800, 0, 0, 810, 0, 0 };
+  schedule.recordCommit(790, jointPhaseUS, 20);
+  CHECK(schedule.getStats().splitCommits == 0);
+  CHECK(schedule.getStats().jointSkewUS == 3 * 500);
+}
+
+int main() {
+  testDegreeConversion();
+  testStaging();
+  testStagger();
+  testCommitWithinOnePeriod();
+  testCommitAcrossPeriodStart();
+  testOnlyAttachedJointsCount();
+  return testResult("servoScheduleTest");
+}
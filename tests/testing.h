@@ -0,0 +1,30 @@
+/**
+  2023-24 Host Tests
+
+  Bare bones checks for the tests in this folder, they only need a C++ compiler.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+static int testFailures = 0;
+static int testChecks = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    testChecks++;                                                              \
+    if (!(condition)) {                                                        \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);     \
+      testFailures++;                                                          \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_NEAR(value, expected, tolerance) CHECK((value) >= (expected) - (tolerance) && (value) <= (expected) + (tolerance))
+
+/**
+ * Print the result of a test program, use it as the return value of main()
+ */
+static int testResult(const char *name) {
+  printf("%s: %d checks, %d failed\n", name, testChecks, testFailures);
+  return testFailures == 0 ? 0 : 1;
+}
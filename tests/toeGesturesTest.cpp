@@ -0,0 +1,286 @@
+/**
+  Toe gesture recognizer: taps, holds, chords, sequences and edges that arrive from another thread
+ */
+
+#include "testing.h"
+#include "servoSchedule.h"
+#include "jointCalibration.h"
+#include "toeGestures.h"
+#include "handConfig.h"
+
+// The gestures the arm runs
+const ToeGestureRule *rules = toeGestureTable;
+const int ruleCount = toeGestureCount;
+
+// A hold sequence and an ambiguous prefix
+const ToeGestureRule holdRules[] = {
+  { { STEP_HOLD_BIG, STEP_TAP_SMALL }, ACTION_SET_MODE, 2, "Hold Big Then Small" },
+  { { STEP_TAP_BIG }, ACTION_SET_MODE, 1, "Big Tap" },
+  { { STEP_TAP_BIG, STEP_TAP_BIG, STEP_TAP_BIG }, ACTION_SET_MODE, 3, "Big Triple Tap" },
+};
+const int holdRuleCount = sizeof(holdRules) / sizeof(holdRules[0]);
+
+static bool fired(ToeGestureRecognizer &recognizer, const char *name) {
+  ToeGestureEvent event;
+  if (!recognizer.poll(event)) return false;
+  return strcmp(event.name, name) == 0;
+}
+
+static void tap(ToeGestureRecognizer &recognizer, uint8_t toe, unsigned long at) {
+  recognizer.edge(toe, true, at);
+  recognizer.update(at);
+  recognizer.edge(toe, false, at + 100);
+  recognizer.update(at + 100);
+}
+
+static void testTapSequences() {
+  ToeGestureRecognizer recognizer(rules, ruleCount);
+  tap(recognizer, BIG_TOE, 1000);
+  tap(recognizer, SMALL_TOE, 1300);
+  CHECK(fired(recognizer, "Big Then Small Toes"));
+
+  tap(recognizer, SMALL_TOE, 5000);
+  tap(recognizer, BIG_TOE, 5300);
+  CHECK(fired(recognizer, "Small Toes Then Big"));
+
+  // Tapping the same toe twice grips or releases a little more and never changes the mode
+  tap(recognizer, SMALL_TOE, 9000);
+  tap(recognizer, SMALL_TOE, 9300);
+  tap(recognizer, BIG_TOE, 13000);
+  tap(recognizer, BIG_TOE, 13300);
+  tap(recognizer, BIG_TOE, 13600);
+  recognizer.update(20000);
+  CHECK(!fired(recognizer, ""));
+}
+
+static void testSequenceWindow() {
+  ToeGestureRecognizer recognizer(rules, ruleCount);
+  tap(recognizer, BIG_TOE, 1000);
+  recognizer.update(4000);
+  tap(recognizer, SMALL_TOE, 4000);
+  CHECK(!fired(recognizer, "Big Then Small Toes"));
+}
+
+static void testSlowPressIsNotATap() {
+  ToeGestureRecognizer recognizer(rules, ruleCount);
+  recognizer.edge(BIG_TOE, true, 1000);
+  recognizer.update(1000);
+  recognizer.edge(BIG_TOE, false, 1600);
+  tap(recognizer, SMALL_TOE, 1700);
+  CHECK(!fired(recognizer, "Big Then Small Toes"));
+}
+
+static void testChord() {
+  ToeGestureRecognizer recognizer(rules, ruleCount);
+  recognizer.edge(BIG_TOE, true, 1000);
+  recognizer.edge(SMALL_TOE, true, 1050);
+  recognizer.update(1100);
+  CHECK(!fired(recognizer, ""));
+
+  // Decided on the first release, the other release is not a tap
+  recognizer.edge(BIG_TOE, false, 1150);
+  ToeGestureEvent event;
+  CHECK(recognizer.poll(event));
+  CHECK(event.action == ACTION_WRIST_LOCK && event.latencyMS == 0);
+  recognizer.edge(SMALL_TOE, false, 1160);
+  recognizer.update(5000);
+  CHECK(!fired(recognizer, ""));
+
+  // Too far apart for a chord
+  recognizer.edge(BIG_TOE, true, 6000);
+  recognizer.edge(SMALL_TOE, true, 6300);
+  CHECK(!fired(recognizer, "Both Toes"));
+}
+
+static void holdBothToes(ToeGestureRecognizer &recognizer, unsigned long at, unsigned long forMS) {
+  recognizer.edge(SMALL_TOE, true, at);
+  recognizer.edge(BIG_TOE, true, at + 30);
+  for (unsigned long now = at + 30; now <= at + 30 + forMS; now += 10) recognizer.update(now);
+  recognizer.edge(BIG_TOE, false, at + 30 + forMS);
+  recognizer.edge(SMALL_TOE, false, at + 40 + forMS);
+  recognizer.update(at + 40 + forMS);
+}
+
+static void testChordHold() {
+  ToeGestureRecognizer recognizer(rules, ruleCount);
+
+  // Held once is not enough and does not lock the wrist
+  holdBothToes(recognizer, 1000, 900);
+  CHECK(!fired(recognizer, ""));
+  holdBothToes(recognizer, 2500, 900);
+  CHECK(fired(recognizer, "Both Toes Held Twice"));
+  CHECK(!fired(recognizer, ""));
+
+  // Released between two updates, still a hold
+  recognizer.edge(BIG_TOE, true, 6000);
+  recognizer.edge(SMALL_TOE, true, 6010);
+  recognizer.update(6500);
+  recognizer.edge(SMALL_TOE, false, 6815);
+  recognizer.edge(BIG_TOE, false, 6820);
+  holdBothToes(recognizer, 7500, 900);
+  CHECK(fired(recognizer, "Both Toes Held Twice"));
+
+  // Held, then pressed together goes back to the full grip
+  holdBothToes(recognizer, 9000, 900);
+  recognizer.edge(BIG_TOE, true, 10300);
+  recognizer.edge(SMALL_TOE, true, 10320);
+  recognizer.edge(SMALL_TOE, false, 10400);
+  recognizer.edge(BIG_TOE, false, 10410);
+  ToeGestureEvent event;
+  CHECK(recognizer.poll(event));
+  CHECK(event.action == ACTION_SET_MODE && event.value == 0);
+
+  // Holding the small toes to open the hand, twice, is only releasing
+  recognizer.update(12000);
+  for (unsigned long at = 12000; at <= 14000; at += 2000) {
+    recognizer.edge(SMALL_TOE, true, at);
+    for (unsigned long now = at; now <= at + 1000; now += 10) recognizer.update(now);
+    recognizer.edge(SMALL_TOE, false, at + 1000);
+  }
+  recognizer.update(20000);
+  CHECK(!fired(recognizer, ""));
+}
+
+static void testHold() {
+  ToeGestureRecognizer recognizer(holdRules, holdRuleCount);
+  recognizer.edge(BIG_TOE, true, 1000);
+  recognizer.update(1700);
+  CHECK(!fired(recognizer, ""));
+  recognizer.update(1800);
+  recognizer.edge(BIG_TOE, false, 2500);
+  tap(recognizer, SMALL_TOE, 2600);
+
+  ToeGestureEvent event;
+  CHECK(recognizer.poll(event));
+  CHECK(event.action == ACTION_SET_MODE && event.value == 2);
+}
+
+static void testAmbiguousPrefixWaits() {
+  ToeGestureRecognizer recognizer(holdRules, holdRuleCount);
+  tap(recognizer, BIG_TOE, 1000);
+  CHECK(!fired(recognizer, ""));
+
+  // Nothing followed within the sequence window, so the short gesture fires late
+  recognizer.update(3200);
+  ToeGestureEvent event;
+  CHECK(recognizer.poll(event));
+  CHECK(event.value == 1);
+  CHECK(event.latencyMS == 2100);
+}
+
+/**
+ * Plays every gesture of the table the way a foot does, with the recognizer run from a 10 ms control tick, and
+ * measures the time from the moment the gesture is complete (the release of a tap or chord, the moment a hold
+ * is long enough) to the tick that polls it
+ */
+static void testTableLatency() {
+  const unsigned long tickMS = 10;
+  const ToeGestureTiming timing = defaultToeGestureTiming;
+  printf("toeGestureTable decision latency\n");
+
+  for (int i = 0; i < toeGestureCount; i++) {
+    const ToeGestureRule &rule = toeGestureTable[i];
+    ToeGestureRecognizer recognizer(toeGestureTable, toeGestureCount);
+
+    // Edges of every step, 250 ms apart and off the tick so a late decision shows
+    ToeEdge edges[4 * TOE_GESTURE_MAX_STEPS];
+    int edgeCount = 0;
+    unsigned long at = 1003;
+    unsigned long completeAt = 0;
+    for (int step = 0; step < TOE_GESTURE_MAX_STEPS && rule.steps[step] != STEP_NONE; step++) {
+      ToeGestureStep kind = rule.steps[step];
+      bool both = kind == STEP_CHORD || kind == STEP_HOLD_CHORD;
+      bool held = kind == STEP_HOLD_BIG || kind == STEP_HOLD_SMALL || kind == STEP_HOLD_CHORD;
+      uint8_t toe = kind == STEP_TAP_SMALL || kind == STEP_HOLD_SMALL ? SMALL_TOE : BIG_TOE;
+      unsigned long pressedAt = at + (both ? 30 : 0);
+      unsigned long releasedAt = pressedAt + (held ? timing.longPressMS + 200 : 100);
+
+      edges[edgeCount++] = { toe, true, at };
+      if (both) edges[edgeCount++] = { SMALL_TOE, true, pressedAt };
+      edges[edgeCount++] = { toe, false, releasedAt };
+      if (both) edges[edgeCount++] = { SMALL_TOE, false, releasedAt + 10 };
+      completeAt = held ? pressedAt + timing.longPressMS : releasedAt;
+      at = releasedAt + 250;
+    }
+
+    ToeGestureEvent event;
+    bool decided = false;
+    unsigned long polledAt = 0;
+    int next = 0;
+    for (unsigned long now = 1000; now < at + 3000 && !decided; now += tickMS) {
+      while (next < edgeCount && edges[next].at <= now) {
+        recognizer.edge(edges[next].toe, edges[next].pressed, edges[next].at);
+        next++;
+      }
+      recognizer.update(now);
+      decided = recognizer.poll(event);
+      polledAt = now;
+    }
+
+    CHECK(decided && strcmp(event.name, rule.name) == 0);
+    if (!decided) continue;
+    unsigned long latencyMS = polledAt - completeAt;
+    printf("  %-26s %3lu ms to poll, %3lu ms reported\n", rule.name, latencyMS, event.latencyMS);
+    // Decided by the next control tick, none of them waits out the sequence window
+    CHECK(latencyMS <= tickMS);
+    CHECK(event.latencyMS <= tickMS);
+  }
+}
+
+// An edge stamped by the radio callback after the loop sampled now must still count as a tap
+static void testEdgeStampedAfterNow() {
+  ToeGestureRecognizer recognizer(rules, ruleCount);
+  tap(recognizer, BIG_TOE, 4700);
+  recognizer.edge(SMALL_TOE, true, 5001);
+  recognizer.update(5000);
+  recognizer.edge(SMALL_TOE, false, 5100);
+  recognizer.update(5100);
+  CHECK(fired(recognizer, "Big Then Small Toes"));
+}
+
+// The same race through the queue the arm uses between the ESP-NOW callback and the control loop
+static void testEdgeQueue() {
+  ToeGestureRecognizer recognizer(rules, ruleCount);
+  ToeEdgeQueue queue;
+
+  CHECK(queue.push(BIG_TOE, true, 1000));
+  CHECK(!queue.push(BIG_TOE, true, 1010));  // same payload again
+  CHECK(queue.push(BIG_TOE, false, 1100));
+  CHECK(queue.push(SMALL_TOE, true, 1201));
+  CHECK(!queue.push(7, true, 1201));
+
+  ToeEdge edge;
+  unsigned long lastAt = 0;
+  while (queue.pop(edge)) {
+    CHECK(edge.at >= lastAt);
+    lastAt = edge.at;
+    recognizer.edge(edge.toe, edge.pressed, edge.at);
+  }
+  recognizer.update(1200);
+  queue.push(SMALL_TOE, false, 1300);
+  while (queue.pop(edge)) recognizer.edge(edge.toe, edge.pressed, edge.at);
+  recognizer.update(1300);
+  CHECK(fired(recognizer, "Big Then Small Toes"));
+
+  // A full queue drops the edge and takes it again from the next payload
+  ToeEdgeQueue full;
+  for (int i = 0; i < TOE_EDGE_QUEUE_SIZE; i++) CHECK(full.push(i % 2, i % 4 < 2, i));
+  CHECK(!full.push(BIG_TOE, true, 100));
+  CHECK(full.getDropped() == 1);
+  full.pop(edge);
+  CHECK(full.push(BIG_TOE, true, 101));
+}
+
+int main() {
+  testTapSequences();
+  testSequenceWindow();
+  testSlowPressIsNotATap();
+  testChord();
+  testChordHold();
+  testHold();
+  testAmbiguousPrefixWaits();
+  testTableLatency();
+  testEdgeStampedAfterNow();
+  testEdgeQueue();
+  return testResult("toeGesturesTest");
+}
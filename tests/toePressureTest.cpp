@@ -0,0 +1,115 @@
+/**
+  Toe pressure mapping: runs pressure traces shaped like the ones a foot unit sends in pressure mode through the
+  mapper and checks the virtual presses, the grip speeds and that button presses keep the button speed
+ */
+
+#include "testing.h"
+#include "toeGestures.h"
+#include "toePressure.h"
+
+struct PressureTrace {
+  const char *name;
+  uint8_t values[40];  // one packet from the foot unit each, ends at the first 0 after a non zero value
+};
+
+// Feed one toe's trace, like PressureAssign() does, and count the virtual presses and releases
+static int edges(ToePressureMapper &mapper, const PressureTrace &trace, int &presses) {
+  int count = 0;
+  presses = 0;
+  bool started = false;
+  for (uint8_t value : trace.values) {
+    if (mapper.sample(BIG_TOE, value)) {
+      count++;
+      if (mapper.isDown(BIG_TOE)) presses++;
+    }
+    if (value) started = true;
+    else if (started) break;
+  }
+  return count;
+}
+
+static void testTraces() {
+  const PressureTrace traces[] = {
+    { "firm tap", { 0, 30, 120, 220, 250, 240, 180, 90, 20, 0 } },
+    { "slow press", { 5, 15, 25, 35, 45, 55, 65, 75, 85, 95, 105, 110, 110, 100, 80, 60, 45, 38, 20, 0 } },
+    { "wobbling toe", { 10, 60, 85, 70, 95, 60, 88, 45, 75, 50, 90, 42, 30, 0 } },
+    { "resting foot", { 20, 35, 28, 39, 31, 36, 25, 0 } },
+  };
+  const int expectedPresses[] = { 1, 1, 1, 0 };
+
+  for (int i = 0; i < 4; i++) {
+    ToePressureMapper mapper;
+    int presses;
+    int count = edges(mapper, traces[i], presses);
+    printf("  %-14s %d presses, %d edges\n", traces[i].name, presses, count);
+    CHECK(presses == expectedPresses[i]);
+    // Every press is released again, the wobble in between never chatters
+    CHECK(count == 2 * presses);
+    CHECK(!mapper.isDown(BIG_TOE));
+  }
+}
+
+static void testVelocity() {
+  ToePressureMapper mapper;
+  mapper.sample(BIG_TOE, 80);
+  mapper.press(BIG_TOE, true);
+
+  // Pressing harder grips faster, all the way up to maxSpeed
+  float previous = 0;
+  for (int value = 80; value <= 255; value += 25) {
+    mapper.sample(BIG_TOE, value);
+    float speed = mapper.speed(BIG_TOE, 0.5f);
+    CHECK(speed > previous);
+    previous = speed;
+  }
+  mapper.sample(BIG_TOE, 255);
+  CHECK_NEAR(mapper.speed(BIG_TOE, 0.5f), defaultToePressureSettings.maxSpeed, 1e-6f);
+  mapper.sample(BIG_TOE, defaultToePressureSettings.releaseThreshold + 1);
+  CHECK(mapper.isDown(BIG_TOE));
+  CHECK_NEAR(mapper.speed(BIG_TOE, 0.5f), defaultToePressureSettings.minSpeed, 0.01f);
+}
+
+static void testTarget() {
+  ToePressureMapper mapper;
+  mapper.mode = PRESSURE_GRIP_TARGET;
+  mapper.sample(BIG_TOE, 150);
+  mapper.press(BIG_TOE, true);
+
+  // Grip passes stop where the pressure says, and go on once it goes up
+  float progress = 0;
+  for (int pass = 0; pass < 200; pass++) progress += 0.01f * mapper.speed(BIG_TOE, progress);
+  CHECK_NEAR(progress, mapper.level(BIG_TOE), 0.011f);
+  mapper.sample(BIG_TOE, 255);
+  for (int pass = 0; pass < 200; pass++) progress += 0.01f * mapper.speed(BIG_TOE, progress);
+  CHECK(progress >= 1);
+}
+
+static void testButtonPresses() {
+  ToePressureMapper mapper;
+
+  // A pressure press, then the buttons of the other foot unit: only the pressure press sets the speed
+  mapper.sample(BIG_TOE, 255);
+  mapper.press(BIG_TOE, true);
+  CHECK_NEAR(mapper.speed(BIG_TOE, 0), defaultToePressureSettings.maxSpeed, 1e-6f);
+  mapper.sample(BIG_TOE, 0);
+  mapper.press(BIG_TOE, false);
+  CHECK(mapper.speed(BIG_TOE, 0) == 1);
+
+  // Target mode would leave a button press standing still at zero pressure
+  mapper.mode = PRESSURE_GRIP_TARGET;
+  CHECK(mapper.speed(BIG_TOE, 0) == 1);
+
+  // The small toes keep their own source
+  mapper.press(SMALL_TOE, true);
+  CHECK(mapper.isPressedByPressure(SMALL_TOE));
+  CHECK(!mapper.isPressedByPressure(BIG_TOE));
+}
+
+int main() {
+  printf("pressure traces\n");
+  testTraces();
+  testVelocity();
+  testTarget();
+  testButtonPresses();
+  return testResult("toePressureTest");
+}
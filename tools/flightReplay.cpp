@@ -0,0 +1,47 @@
+/**
+  2023-24 Flight Recording Replay
+
+  Usage: flightReplay [-v] flightrec.bin
+    -v also prints every servo record
+ */
+
+#include <stdlib.h>
+#include "flightReplay.h"
+
+int main(int argc, char **argv) {
+  bool verbose = argc == 3 && strcmp(argv[1], "-v") == 0;
+  if (argc != 2 && !verbose) {
+    fprintf(stderr, "usage: %s [-v] flightrec.bin\n", argv[0]);
+    return 2;
+  }
+
+  FILE *file = fopen(argv[argc - 1], "rb");
+  if (!file) {
+    perror(argv[argc - 1]);
+    return 1;
+  }
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint8_t *data = (uint8_t *)malloc(length > 0 ? length : 1);
+  size_t read = fread(data, 1, length, file);
+  fclose(file);
+
+  const char *problem = FlightReplay::check(data, read);
+  if (problem) {
+    fprintf(stderr, "%s: %s\n", argv[argc - 1], problem);
+    free(data);
+    return 1;
+  }
+
+  FlightReplay replay(stdout, verbose);
+  replay.run(data, read);
+  free(data);
+
+  FlightReplayStats stats = replay.getStats();
+  printf("\n%lu records, %lu boots, %lu toe edges, %lu toe pressures, %lu servo records\n", stats.records, stats.boots, stats.toeEdges, stats.toePressures,
+         stats.servoRecords);
+  printf("gestures recorded / replayed / mismatched: %lu / %lu / %lu\n", stats.recordedGestures, stats.replayedGestures, stats.gestureMismatches);
+  if (stats.pressureMismatches) printf("virtual toe presses mismatched: %lu\n", stats.pressureMismatches);
+  return stats.gestureMismatches == 0 && stats.pressureMismatches == 0 ? 0 : 3;
+}
@@ -0,0 +1,171 @@
+/**
+  2023-24 Flight Recording Replay
+
+  Replays a flight recording from the arm (GET /recording, see flightRecorder.h) on a computer. The toe edges go
+  through the same gesture recognizer and gesture table the arm runs, so every gesture the arm recorded can be
+  checked against what the recognizer decides from the recorded edges. Servo records are turned back into joint
+  positions with the arm's calibration tables. In pressure mode the recorded toe pressures go through the arm's
+  pressure mapper, and each virtual press the arm recorded is checked against the one the replay makes.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "servoSchedule.h"
+#include "jointCalibration.h"
+#include "toeGestures.h"
+#include "handConfig.h"
+#include "toePressure.h"
+#include "flightRecordFormat.h"
+
+const char *const flightRecordTypeNames[] = { "?", "boot", "toe edge", "wrist input", "gesture", "mode", "servo", "link", "toe pressure" };
+const char *const flightRecordSourceNames[] = { "arm", "foot sleeve", "foot controller" };
+const char *const jointNames[SERVO_JOINT_COUNT] = { "thumb", "thumb base", "index", "middle", "ring", "pinky", "rotation", "bending" };
+const JointTable *const jointTables[SERVO_JOINT_COUNT] = { &thumbTable, &thumbBaseTable, &indexTable, &middleTable, &ringTable, &pinkTable, nullptr, nullptr };
+
+struct FlightReplayStats {
+  unsigned long records;
+  unsigned long boots;
+  unsigned long toeEdges;
+  unsigned long toePressures;
+  unsigned long pressureMismatches;  // virtual presses the arm recorded that the replayed pressures do not make
+  unsigned long servoRecords;
+  unsigned long recordedGestures;
+  unsigned long replayedGestures;
+  unsigned long gestureMismatches;  // recorded gestures the replay did not decide the same way
+};
+
+class FlightReplay {
+  private:
+    ToeGestureRecognizer gestures;
+    ToePressureMapper pressures;
+    FlightReplayStats stats = {};
+    FILE *out;
+    bool verbose;
+
+    unsigned long long timeUS = 0;  // unwrapped
+    uint32_t lastRecordUS = 0;
+    bool started = false;
+
+    void print(const FlightRecord &record) {
+      if (!out) return;
+      const char *type = record.type < sizeof(flightRecordTypeNames) / sizeof(flightRecordTypeNames[0]) ? flightRecordTypeNames[record.type] : "?";
+      fprintf(out, "%12.3f ms  %-12s", timeUS / 1000.0, type);
+      if (record.type == RECORD_SERVO) {
+        if (record.source >= SERVO_JOINT_COUNT) {
+          fprintf(out, " joint %d, %d us\n", record.source, record.a);
+        } else if (jointTables[record.source] && record.a != 0) {
+          fprintf(out, " %s, %d us = position %.2f\n", jointNames[record.source], record.a, jointPosition(*jointTables[record.source], record.a));
+        } else {
+          fprintf(out, " %s, %d us\n", jointNames[record.source], record.a);
+        }
+        return;
+      }
+      const char *source = record.source < 3 ? flightRecordSourceNames[record.source] : "?";
+      fprintf(out, " %-16s a = %d, b = %ld\n", source, record.a, (long)record.b);
+    }
+
+    void comparePressureEdge(const FlightRecord &record) {
+      if (pressures.isDown(record.a) == (record.b == 1)) return;
+      stats.pressureMismatches++;
+      if (out) fprintf(out, "  !! the arm recorded toe %d %s, the replayed pressure %d says otherwise\n", record.a, record.b == 1 ? "pressed" : "released", pressures.getPressure(record.a));
+    }
+
+    void compareGesture(const FlightRecord &record) {
+      stats.recordedGestures++;
+      ToeGestureEvent event;
+      if (!gestures.poll(event)) {
+        stats.gestureMismatches++;
+        if (out) fprintf(out, "  !! the arm recorded gesture action %d, the replay decided nothing\n", record.a);
+        return;
+      }
+      stats.replayedGestures++;
+      if (event.action != record.a) {
+        stats.gestureMismatches++;
+        if (out) fprintf(out, "  !! the arm recorded gesture action %d, the replay decided \"%s\"\n", record.a, event.name);
+      } else if (out) {
+        fprintf(out, "  replay: \"%s\", decided in %lu ms (arm: %ld ms)\n", event.name, event.latencyMS, (long)record.b);
+      }
+    }
+
+  public:
+    FlightReplay(FILE *out = stdout, bool verbose = false)
+      : gestures(toeGestureTable, toeGestureCount), out(out), verbose(verbose) {}
+
+    /**
+     * Check that a recording can be replayed
+     * @returns nullptr if it can, otherwise what is wrong with it
+     */
+    static const char *check(const uint8_t *data, size_t length) {
+      if (length < sizeof(FlightRecordingHeader)) return "too short for a header";
+      FlightRecordingHeader header;
+      memcpy(&header, data, sizeof(header));
+      if (header.magic != FLIGHT_RECORDER_MAGIC) return "not a flight recording";
+      if (header.version != FLIGHT_RECORDER_VERSION) return "recorded by a different firmware version";
+      if (header.recordSize != sizeof(FlightRecord)) return "unexpected record size";
+      if (length < sizeof(header) + (size_t)header.recordCount * sizeof(FlightRecord)) return "recording is cut short";
+      return nullptr;
+    }
+
+    /**
+     * Replay a whole recording, check() it first
+     */
+    void run(const uint8_t *data, size_t length) {
+      FlightRecordingHeader header;
+      memcpy(&header, data, sizeof(header));
+      if (out) {
+        fprintf(out, "%lu records, %lu dropped, saved after reset reason %lu\n",
+                (unsigned long)header.recordCount, (unsigned long)header.droppedRecords, (unsigned long)header.resetReason);
+      }
+
+      for (uint32_t i = 0; i < header.recordCount && sizeof(header) + (i + 1) * sizeof(FlightRecord) <= length; i++) {
+        FlightRecord record;
+        memcpy(&record, data + sizeof(header) + i * sizeof(FlightRecord), sizeof(record));
+        add(record);
+      }
+
+      // Let a gesture that was still waiting for a longer one time out
+      gestures.update(timeUS / 1000 + defaultToeGestureTiming.sequenceWindowMS + 1);
+      ToeGestureEvent event;
+      while (gestures.poll(event)) {
+        stats.replayedGestures++;
+        if (out) fprintf(out, "  replay only: \"%s\"\n", event.name);
+      }
+    }
+
+    /**
+     * Replay one record
+     */
+    void add(const FlightRecord &record) {
+      stats.records++;
+      if (started) timeUS += (uint32_t)(record.timeUS - lastRecordUS);
+      else timeUS = record.timeUS;
+      started = true;
+      lastRecordUS = record.timeUS;
+      unsigned long nowMS = timeUS / 1000;
+
+      if (record.type == RECORD_BOOT) {
+        stats.boots++;
+        gestures = ToeGestureRecognizer(toeGestureTable, toeGestureCount);
+        pressures = ToePressureMapper();
+      }
+      if (record.type == RECORD_SERVO) stats.servoRecords++;
+      if (record.type != RECORD_SERVO || verbose) print(record);
+
+      if (record.type == RECORD_TOE_PRESSURE && (record.a == BIG_TOE || record.a == SMALL_TOE)) {
+        stats.toePressures++;
+        pressures.sample(record.a, record.b);
+      }
+      if (record.type == RECORD_TOE_EDGE && (record.a == BIG_TOE || record.a == SMALL_TOE)) {
+        stats.toeEdges++;
+        // Pressure mode: the arm makes the virtual presses itself, from the pressures recorded just before
+        if (record.source == SOURCE_ARM) comparePressureEdge(record);
+        gestures.edge(record.a, record.b == 1, nowMS);
+      }
+      gestures.update(nowMS);
+
+      // The arm records a gesture right after deciding it, in the same control tick
+      if (record.type == RECORD_GESTURE) compareGesture(record);
+    }
+
+    FlightReplayStats getStats() { return stats; }
+};
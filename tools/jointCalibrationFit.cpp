@@ -0,0 +1,73 @@
+/**
+  2023-24 Joint Calibration Fit
+
+  Usage: jointCalibrationFit [-n points] name openAngle closedAngle samples.csv
+    name        joint name for the printed array, e.g. index gives indexCalibration
+    openAngle   measured joint angle of the open hand, in degrees
+    closedAngle measured joint angle of the closed hand
+    samples.csv one "pulse us, angle" pair per line, lines that do not start with a number are skipped
+    -n          number of calibration points, 5 if not given
+
+  Prints the calibration points to paste into the Joint Calibration section of handConfig.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jointCalibrationFit.h"
+
+static int readSamples(const char *path, AngleSample *samples) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    perror(path);
+    return -1;
+  }
+
+  char line[128];
+  int count = 0;
+  while (fgets(line, sizeof(line), file) && count < FIT_MAX_SAMPLES) {
+    unsigned pulseUS;
+    float angle;
+    if (sscanf(line, "%u%*[ ,;\t]%f", &pulseUS, &angle) != 2) continue;
+    samples[count].pulseUS = pulseUS;
+    samples[count].angle = angle;
+    count++;
+  }
+  fclose(file);
+  return count;
+}
+
+int main(int argc, char **argv) {
+  int pointCount = 5;
+  int arg = 1;
+  if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+    pointCount = atoi(argv[2]);
+    arg = 3;
+  }
+  if (argc - arg != 4) {
+    fprintf(stderr, "usage: %s [-n points] name openAngle closedAngle samples.csv\n", argv[0]);
+    return 2;
+  }
+
+  const char *name = argv[arg];
+  float openAngle = atof(argv[arg + 1]);
+  float closedAngle = atof(argv[arg + 2]);
+  static AngleSample samples[FIT_MAX_SAMPLES];
+  int count = readSamples(argv[arg + 3], samples);
+  if (count < 0) return 1;
+
+  JointFit fit;
+  const char *problem = fitJointCalibration(samples, count, openAngle, closedAngle, pointCount, fit);
+  if (problem) {
+    fprintf(stderr, "%s: %s\n", argv[arg + 3], problem);
+    return 1;
+  }
+
+  printf("// %d samples, max error %.3f positions (%.3f with the open and closed points alone)\n", count, fit.maxError, fit.twoPointMaxError);
+  printf("constexpr CalibrationPoint %sCalibration[] = {", name);
+  for (int point = 0; point < fit.pointCount; point++) {
+    printf("%s { %g, %u }", point ? "," : "", fit.points[point].position, (unsigned)fit.points[point].pulseUS);
+  }
+  printf(" };\n");
+  return 0;
+}
@@ -0,0 +1,123 @@
+/**
+  2023-24 Joint Calibration Fit
+
+  Fits the calibration points of one joint (see jointCalibration.h) from measured angle samples: pulse widths
+  sent to the joint's servo, each with the joint angle measured at it. The angles become positions between
+  the open and the closed angle, the noise is taken out by fitting the closest curve that only moves one
+  way, and that curve is read back at evenly spaced positions to give the pulse widths for handConfig.h.
+
+  The fit also reports how far the table it makes is off from the samples, next to a straight line between
+  the open and closed pulse widths, so it is easy to see whether the extra points are worth it.
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include "servoSchedule.h"
+#include "jointCalibration.h"
+
+#define FIT_MAX_SAMPLES 512
+
+struct AngleSample {
+  uint16_t pulseUS;
+  float angle;  // degrees, from any zero as long as the open and closed angles use the same one
+};
+
+struct JointFit {
+  int pointCount;
+  CalibrationPoint points[JOINT_TABLE_SIZE];
+  JointTable table;
+  float maxError;          // positions, largest gap between a sample and the table
+  float twoPointMaxError;  // the same for a table from the open and closed pulse widths alone
+};
+
+/**
+ * Largest gap between where the samples say a pulse puts the joint and where the table says it does
+ */
+inline float jointTableMaxError(const JointTable &table, const AngleSample *samples, int count, float openAngle, float closedAngle) {
+  float maxError = 0;
+  for (int i = 0; i < count; i++) {
+    float position = (samples[i].angle - openAngle) / (closedAngle - openAngle);
+    if (position < 0 || position > 1) continue;
+    maxError = fmaxf(maxError, fabsf(jointPosition(table, samples[i].pulseUS) - position));
+  }
+  return maxError;
+}
+
+/**
+ * Fit pointCount calibration points, from open to closed
+ * @param pointCount 2 to JOINT_TABLE_SIZE
+ * @returns nullptr if it worked, otherwise what is wrong with the samples
+ */
+inline const char *fitJointCalibration(const AngleSample *samples, int count, float openAngle, float closedAngle, int pointCount, JointFit &fit) {
+  if (count < 2 || count > FIT_MAX_SAMPLES) return "too few or too many samples";
+  if (pointCount < 2 || pointCount > JOINT_TABLE_SIZE) return "a joint takes 2 to JOINT_TABLE_SIZE points";
+  if (openAngle == closedAngle) return "the open and closed angles are the same";
+
+  // Sorted by pulse width
+  uint16_t pulseUS[FIT_MAX_SAMPLES];
+  float position[FIT_MAX_SAMPLES];
+  for (int i = 0; i < count; i++) {
+    int j = i;
+    float samplePosition = (samples[i].angle - openAngle) / (closedAngle - openAngle);
+    for (; j > 0 && pulseUS[j - 1] > samples[i].pulseUS; j--) {
+      pulseUS[j] = pulseUS[j - 1];
+      position[j] = position[j - 1];
+    }
+    pulseUS[j] = samples[i].pulseUS;
+    position[j] = samplePosition;
+  }
+
+  // Which way the joint closes, from the lower and upper half of the pulse widths
+  float lowerSum = 0, upperSum = 0;
+  for (int i = 0; i < count; i++) (i < count / 2 ? lowerSum : upperSum) += position[i];
+  float direction = upperSum / (count - count / 2) >= lowerSum / (count / 2) ? 1 : -1;
+
+  // Pool adjacent samples that go the wrong way into their mean, until the curve only moves one way
+  float blockMean[FIT_MAX_SAMPLES];
+  int blockSize[FIT_MAX_SAMPLES];
+  int blocks = 0;
+  for (int i = 0; i < count; i++) {
+    blockMean[blocks] = direction * position[i];
+    blockSize[blocks] = 1;
+    blocks++;
+    while (blocks > 1 && blockMean[blocks - 2] > blockMean[blocks - 1]) {
+      int size = blockSize[blocks - 2] + blockSize[blocks - 1];
+      blockMean[blocks - 2] = (blockMean[blocks - 2] * blockSize[blocks - 2] + blockMean[blocks - 1] * blockSize[blocks - 1]) / size;
+      blockSize[blocks - 2] = size;
+      blocks--;
+    }
+  }
+  float fitted[FIT_MAX_SAMPLES];
+  for (int block = 0, i = 0; block < blocks; block++) {
+    for (int n = 0; n < blockSize[block]; n++) fitted[i++] = direction * blockMean[block];
+  }
+
+  if (fminf(fitted[0], fitted[count - 1]) > 0.02f || fmaxf(fitted[0], fitted[count - 1]) < 0.98f) return "the samples do not reach both the open and the closed angle";
+
+  // Read the pulse width back at each point, walking the curve from the open end. Just short of either end
+  // takes the end sample.
+  int openEnd = direction > 0 ? 0 : count - 1;
+  int closedEnd = count - 1 - openEnd;
+  fit.pointCount = pointCount;
+  for (int point = 0; point < pointCount; point++) {
+    float target = (float)point / (pointCount - 1);
+    uint16_t pulse = target <= fitted[openEnd] ? pulseUS[openEnd] : pulseUS[closedEnd];
+    for (int step = 0; step < count - 1; step++) {
+      int from = direction > 0 ? step : count - 1 - step;
+      int to = direction > 0 ? from + 1 : from - 1;
+      if (fitted[from] > target || fitted[to] < target) continue;
+      float part = fitted[to] == fitted[from] ? 0 : (target - fitted[from]) / (fitted[to] - fitted[from]);
+      pulse = (uint16_t)(pulseUS[from] + part * ((float)pulseUS[to] - pulseUS[from]) + 0.5f);
+      break;
+    }
+    fit.points[point].position = target;
+    fit.points[point].pulseUS = pulse;
+  }
+
+  fit.table = buildJointTable(fit.points, pointCount, MakeJointTableIndices<JOINT_TABLE_SIZE>::type());
+  CalibrationPoint ends[2] = { fit.points[0], fit.points[pointCount - 1] };
+  JointTable twoPointTable = buildJointTable(ends, 2, MakeJointTableIndices<JOINT_TABLE_SIZE>::type());
+  fit.maxError = jointTableMaxError(fit.table, samples, count, openAngle, closedAngle);
+  fit.twoPointMaxError = jointTableMaxError(twoPointTable, samples, count, openAngle, closedAngle);
+  return nullptr;
+}